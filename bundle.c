@@ -0,0 +1,198 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "bundle.h"
+#include "debug.h"
+#include "fbida/fbi.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define BUNDLE_MAGIC    "FRBNB01"
+#define BUNDLE_ALIGN    4096
+#define BUNDLE_ALIGNED(x) (((x) + BUNDLE_ALIGN - 1) & ~((uint64_t)BUNDLE_ALIGN - 1))
+#define BUNDLE_DIM_MAX  16384   // max. image width and height
+
+typedef struct bundle_header
+{
+    char     magic[8];
+    uint32_t xMax;
+    uint32_t yMax;
+    // bundle_index for every image follows
+} bundle_header;
+
+typedef struct bundle_index
+{
+    uint64_t offset;    // from file start, BUNDLE_ALIGN aligned
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;    // bytes per line, RGB
+    uint32_t reserved;
+} bundle_index;
+
+struct bundle
+{
+    uint8_t *map;
+    size_t  maplen;
+    const bundle_header *hdr;
+    const bundle_index  *index;
+};
+
+
+bundle *bundle_open(const char *fileName)
+{
+    bundle *b;
+    struct stat st;
+    uint8_t *map;
+    const bundle_header *hdr;
+    const bundle_index *index;
+    int fd;
+    int i;
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) { return NULL; }
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < BUNDLE_ALIGN))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // tiles are only read (converted, scaled, drawn), never written
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return NULL; }
+
+    hdr = (const bundle_header *)map;
+    index = (const bundle_index *)(hdr + 1);
+    if (   (memcmp(hdr->magic, BUNDLE_MAGIC, sizeof(hdr->magic)) != 0)
+        || (hdr->xMax < 1) || (hdr->xMax > 9) || (hdr->yMax < 1) || (hdr->yMax > 9))
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    for (i = 0; i < hdr->xMax * hdr->yMax; ++i)
+    {
+        // no overflow: every value is checked before it is used in a sum,
+        // the product of two 32 bit values fits into 64 bit
+        if (   (index[i].width < 1) || (index[i].width > BUNDLE_DIM_MAX)
+            || (index[i].height < 1) || (index[i].height > BUNDLE_DIM_MAX)
+            || ((uint64_t)index[i].stride < (uint64_t)index[i].width * 3)
+            || ((index[i].stride % 4) != 0)
+            || (index[i].offset < BUNDLE_ALIGN)
+            || ((index[i].offset % BUNDLE_ALIGN) != 0)
+            || (index[i].offset > (uint64_t)st.st_size)
+            || ((uint64_t)index[i].stride * index[i].height > (uint64_t)st.st_size - index[i].offset))
+        {
+            debugOut(debug_level0, "bundle %s: image %d damaged\n", fileName, i + 1);
+            munmap(map, st.st_size);
+            return NULL;
+        }
+    }
+
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    b->map = map;
+    b->maplen = st.st_size;
+    b->hdr = hdr;
+    b->index = index;
+
+    return b;
+}
+
+
+void bundle_close(bundle *b)
+{
+    if (b != NULL)
+    {
+        munmap(b->map, b->maplen);
+        free(b);
+    }
+}
+
+
+void bundle_layout(const bundle *b, uint8_t *xMax, uint8_t *yMax)
+{
+    *xMax = b->hdr->xMax;
+    *yMax = b->hdr->yMax;
+}
+
+
+struct ida_image *bundle_image(bundle *b, int idx)
+{
+    const bundle_index *i;
+
+    if ((idx < 0) || (idx >= b->hdr->xMax * b->hdr->yMax)) { return NULL; }
+    i = &b->index[idx];
+
+    return map_image(i->width, i->height, i->stride, b->map + i->offset);
+}
+
+
+int bundle_write(const char *fileName, uint8_t xMax, uint8_t yMax, struct ida_image **imgArr)
+{
+    static const uint8_t zero[BUNDLE_ALIGN];
+    const int cnt = xMax * yMax;
+    bundle_header hdr;
+    bundle_index index[9*9];
+    uint64_t offset;
+    FILE *fp;
+    int i;
+    int retval = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BUNDLE_MAGIC, sizeof(hdr.magic));
+    hdr.xMax = xMax;
+    hdr.yMax = yMax;
+
+    memset(index, 0, sizeof(index));
+    offset = BUNDLE_ALIGNED(sizeof(hdr) + cnt * sizeof(index[0]));
+    for (i = 0; i < cnt; ++i)
+    {
+        index[i].offset = offset;
+        index[i].width  = imgArr[i]->i.width;
+        index[i].height = imgArr[i]->i.height;
+        index[i].stride = pixman_image_get_stride(imgArr[i]->p);
+        offset = BUNDLE_ALIGNED(offset + (uint64_t)index[i].stride * index[i].height);
+    }
+
+    fp = fopen(fileName, "w");
+    if (fp == NULL)
+    {
+        debugOut(debug_level0, "open %s: %s\n", fileName, strerror(errno));
+        return -1;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(index, sizeof(index[0]), cnt, fp);
+    offset = sizeof(hdr) + cnt * sizeof(index[0]);
+    for (i = 0; i < cnt; ++i)
+    {
+        uint64_t size = (uint64_t)index[i].stride * index[i].height;
+
+        fwrite(zero, 1, index[i].offset - offset, fp);
+        fwrite(ida_image_scanline(imgArr[i], 0), 1, size, fp);
+        offset = index[i].offset + size;
+    }
+    fwrite(zero, 1, BUNDLE_ALIGNED(offset) - offset, fp);
+
+    if (ferror(fp)) { retval = -1; }
+    if (fclose(fp) != 0) { retval = -1; }
+
+    return retval;
+}
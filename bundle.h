@@ -0,0 +1,64 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#ifndef _FRABENU_BUNDLE_H_
+#define _FRABENU_BUNDLE_H_
+
+#include <stdint.h>
+
+/*
+ * A bundle holds all decoded images of a menu in one file.
+ * Every image starts page aligned, so it can be used directly
+ * from one mmap() of the whole file.
+ */
+
+typedef struct bundle bundle;
+
+struct ida_image;
+
+/**
+ * @brief Map a bundle file.
+ * @param fileName  Bundle file, e.g. "menu.fbm"
+ * @return          Bundle or NULL if fileName is no bundle or on error.
+ */
+bundle *bundle_open(const char *fileName);
+
+/**
+ * @brief Unmap a bundle.
+ *
+ * All images from bundle_image() must be freed before.
+ * @param b
+ */
+void bundle_close(bundle *b);
+
+/**
+ * @brief Get layout of the bundle.
+ * @param b
+ * @param[out] xMax
+ * @param[out] yMax
+ */
+void bundle_layout(const bundle *b, uint8_t *xMax, uint8_t *yMax);
+
+/**
+ * @brief Get image from bundle without copying any pixel data.
+ * @param b
+ * @param idx   0..(xMax*yMax-1)
+ * @return      Image, free it with free_image(), or NULL on error.
+ */
+struct ida_image *bundle_image(bundle *b, int idx);
+
+/**
+ * @brief Write all images into a new bundle file.
+ * @param fileName  Bundle file to create
+ * @param xMax      1..9
+ * @param yMax      1..9
+ * @param imgArr    xMax*yMax images, same order as menu.imgArr
+ * @return          0 on success, -1 on error
+ */
+int bundle_write(const char *fileName, uint8_t xMax, uint8_t yMax, struct ida_image **imgArr);
+
+#endif // _FRABENU_BUNDLE_H_
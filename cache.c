@@ -0,0 +1,215 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "cache.h"
+#include "debug.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#define CACHE_MAGIC     "FRBNC01"
+#define CACHE_DATA_OFF  4096    // page aligned, so data can be used directly from mmap()
+#define CACHE_KEY_MAX   (CACHE_DATA_OFF - sizeof(cache_header))
+
+typedef struct cache_header
+{
+    char     magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t keyLen;
+    // key string follows, image data at CACHE_DATA_OFF
+} cache_header;
+
+static int  init = 0;
+static char cacheDir[PATH_MAX];
+static gfxstate *cacheGfx;
+static menu_scale_mode cacheScale;
+
+
+/**
+ * @brief Build key and cache file name for an image file.
+ * @param fileName  Source image file
+ * @param[out] key  Key string, CACHE_KEY_MAX bytes
+ * @param[out] path Cache file name, PATH_MAX bytes
+ * @return          0 on success, -1 on error
+ */
+static int buildKey(const char *fileName, char *key, char *path)
+{
+    char real[PATH_MAX];
+    struct stat st;
+    uint64_t hash = 14695981039346656037ULL;    // FNV-1a
+    int len;
+    int i;
+
+    if (realpath(fileName, real) == NULL) { return -1; }
+    if (stat(real, &st) != 0) { return -1; }
+
+    len = snprintf(key, CACHE_KEY_MAX, "%s|%lld.%09ld|%lld|%ux%u|%u|%u:%u,%u:%u,%u:%u,%u:%u|%d",
+                   real, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (long long)st.st_size,
+                   cacheGfx->hdisplay, cacheGfx->vdisplay, cacheGfx->bits_per_pixel,
+                   cacheGfx->rlen, cacheGfx->roff, cacheGfx->glen, cacheGfx->goff,
+                   cacheGfx->blen, cacheGfx->boff, cacheGfx->tlen, cacheGfx->toff, cacheScale);
+    if ((len < 0) || (len >= CACHE_KEY_MAX)) { return -1; }
+
+    for (i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t)key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    len = snprintf(path, PATH_MAX, "%s/%016llx.fbc", cacheDir, (unsigned long long)hash);
+    if ((len < 0) || (len >= PATH_MAX)) { return -1; }
+
+    return 0;
+}
+
+
+int cache_init(const char *dir, gfxstate *gfx, menu_scale_mode scale)
+{
+    if (!init)
+    {
+        if (strlen(dir) >= sizeof(cacheDir)) { return -1; }
+        if ((mkdir(dir, 0755) != 0) && (errno != EEXIST))
+        {
+            debugOut(debug_level0, "Err cache dir %s: %d\n", dir, errno);
+            return -1;
+        }
+        strcpy(cacheDir, dir);
+        cacheGfx = gfx;
+        cacheScale = scale;
+        init = 1;
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+void cache_stop(void)
+{
+    init = 0;
+}
+
+
+struct gfx_image *cache_load(const char *fileName)
+{
+    char key[CACHE_KEY_MAX];
+    char path[PATH_MAX];
+    const cache_header *hdr;
+    struct gfx_image *gimg;
+    struct stat st;
+    uint8_t *map;
+    unsigned int bytes;
+    int fd;
+
+    if (!init) { return NULL; }
+    bytes = (cacheGfx->bits_per_pixel + 7) / 8;
+    if (buildKey(fileName, key, path) != 0) { return NULL; }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < CACHE_DATA_OFF))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return NULL; }
+
+    // the same checks as bundle_open(), a stale or truncated file must not
+    // make shadow_draw_native() read past the map or write past the frame
+    hdr = (const cache_header *)map;
+    if (   (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0)
+        || (hdr->keyLen != strlen(key))
+        || (memcmp(map + sizeof(*hdr), key, hdr->keyLen) != 0)
+        || (hdr->width > cacheGfx->hdisplay)
+        || (hdr->height > cacheGfx->vdisplay)
+        || ((uint64_t)hdr->stride < (uint64_t)hdr->width * bytes)
+        || ((uint64_t)hdr->stride * hdr->height > (uint64_t)(st.st_size - CACHE_DATA_OFF)))
+    {
+        debugOut(debug_level2, "cache mismatch %s\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    gimg = calloc(1, sizeof(*gimg));
+    if (gimg == NULL)
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    gimg->width  = hdr->width;
+    gimg->height = hdr->height;
+    gimg->stride = hdr->stride;
+    gimg->data   = map + CACHE_DATA_OFF;
+    gimg->map    = map;
+    gimg->maplen = st.st_size;
+
+    debugOut(debug_level3, "cache hit %s -> %s\n", fileName, path);
+
+    return gimg;
+}
+
+
+int cache_store(const char *fileName, const struct gfx_image *gimg)
+{
+    char key[CACHE_KEY_MAX];
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    uint8_t head[CACHE_DATA_OFF];
+    cache_header *hdr = (cache_header *)head;
+    size_t size;
+    int fd;
+    int retval = -1;
+
+    if (!init) { return -1; }
+    if (buildKey(fileName, key, path) != 0) { return -1; }
+    if (snprintf(tmp, sizeof(tmp), "%s/.tmpXXXXXX", cacheDir) >= sizeof(tmp)) { return -1; }
+
+    memset(head, 0, sizeof(head));
+    memcpy(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->width  = gimg->width;
+    hdr->height = gimg->height;
+    hdr->stride = gimg->stride;
+    hdr->keyLen = strlen(key);
+    memcpy(head + sizeof(*hdr), key, hdr->keyLen);
+    size = (size_t)gimg->stride * gimg->height;
+
+    // write to temp file and rename, so readers never see partial files
+    fd = mkstemp(tmp);
+    if (fd >= 0)
+    {
+        int ok =    (write(fd, head, sizeof(head)) == sizeof(head))
+                 && (write(fd, gimg->data, size) == size)
+                 && (fchmod(fd, 0644) == 0);
+
+        if ((close(fd) == 0) && ok)
+        {
+            retval = rename(tmp, path);
+        }
+        if (retval != 0)
+        {
+            unlink(tmp);
+        }
+    }
+
+    return retval;
+}
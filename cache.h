@@ -0,0 +1,56 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#ifndef _FRABENU_CACHE_H_
+#define _FRABENU_CACHE_H_
+
+#include "menu.h"
+#include "fbida/gfx.h"
+#include "fbida/fb-gui.h"
+
+/**
+ * Init on-disk cache of images converted to the framebuffer format.
+ *
+ * Cache entries are keyed by the image path, its mtime and size and
+ * the pixel format and resolution of gfx and the scale mode.
+ * Call this only once or after calling cache_stop().
+ *
+ * @param dir   Cache directory, created if missing.
+ * @param gfx   Display the cached images are converted for.
+ * @param scale Scale mode the cached images are converted with.
+ * @return Return 0 on success and a value != 0 on error.
+ */
+int cache_init(const char *dir, gfxstate *gfx, menu_scale_mode scale);
+
+/**
+ * Deinit cache.
+ *
+ * cache_stop() do nothing if cache_init() is not called before.
+ */
+void cache_stop(void);
+
+/**
+ * @brief Map cached image for a file.
+ *
+ * Thread safe.
+ * @param fileName  Source image file.
+ * @return          Mapped image, free it with gfx_image_free(),
+ *                  or NULL if not cached or cache is not initialized.
+ */
+struct gfx_image *cache_load(const char *fileName);
+
+/**
+ * @brief Store an image in the cache.
+ *
+ * Thread safe.
+ * @param fileName  Source image file gimg was converted from.
+ * @param gimg      Image converted for the display given to cache_init().
+ * @return          0 on success, -1 on error or if cache is not initialized.
+ */
+int cache_store(const char *fileName, const struct gfx_image *gimg);
+
+#endif // _FRABENU_CACHE_H_
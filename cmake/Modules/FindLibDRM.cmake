@@ -0,0 +1,47 @@
+# - Try to find libdrm
+# Once done this will define
+#
+#  LIBDRM_FOUND - system has libdrm
+#  LIBDRM_INCLUDE_DIRS - the libdrm include directories
+#  LIBDRM_LIBRARIES - Link these to use libdrm
+#
+
+find_package(PkgConfig QUIET)
+if (PKG_CONFIG_FOUND)
+  pkg_check_modules(PC_LIBDRM QUIET libdrm)
+endif (PKG_CONFIG_FOUND)
+
+find_path(LIBDRM_INCLUDE_DIR
+  NAMES
+    xf86drm.h
+  HINTS
+    ${PC_LIBDRM_INCLUDE_DIRS}
+)
+
+# drm.h and drm_mode.h live in the libdrm subdirectory
+find_path(LIBDRM_UAPI_INCLUDE_DIR
+  NAMES
+    drm.h
+  HINTS
+    ${PC_LIBDRM_INCLUDE_DIRS}
+  PATH_SUFFIXES
+    libdrm
+)
+
+find_library(LIBDRM_LIBRARY
+  NAMES
+    drm
+  HINTS
+    ${PC_LIBDRM_LIBRARY_DIRS}
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibDRM DEFAULT_MSG
+  LIBDRM_LIBRARY LIBDRM_INCLUDE_DIR LIBDRM_UAPI_INCLUDE_DIR)
+
+if (LIBDRM_FOUND)
+  set(LIBDRM_INCLUDE_DIRS ${LIBDRM_INCLUDE_DIR} ${LIBDRM_UAPI_INCLUDE_DIR})
+  set(LIBDRM_LIBRARIES ${LIBDRM_LIBRARY})
+endif (LIBDRM_FOUND)
+
+mark_as_advanced(LIBDRM_INCLUDE_DIR LIBDRM_UAPI_INCLUDE_DIR LIBDRM_LIBRARY)
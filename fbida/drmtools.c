@@ -0,0 +1,411 @@
+/*
+ * drm/kms backend: dumb buffers, double buffered, vsync driven page flips
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "vt.h"
+#include "drmtools.h"
+
+/* -------------------------------------------------------------------- */
+
+struct drm_buf {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint32_t pitch;
+    uint64_t size;
+    uint8_t  *mem;
+};
+
+static int                drm_fd = -1;
+static drmModeConnector   *drm_conn;
+static drmModeModeInfo    drm_mode;
+static drmModeCrtc        *drm_ocrtc;   /* to restore on exit */
+static uint32_t           drm_crtc_id;
+static struct drm_buf     drm_buf[2];
+static int                drm_page;     /* visible buffer */
+static int                drm_flip_pending;
+static gfxstate           *drm_gfx;
+static struct termios     term;
+
+/* -------------------------------------------------------------------- */
+
+static int drm_buf_create(struct drm_buf *buf)
+{
+    struct drm_mode_create_dumb creq;
+    struct drm_mode_map_dumb mreq;
+    struct drm_mode_destroy_dumb dreq;
+
+    memset(&creq, 0, sizeof(creq));
+    creq.width  = drm_mode.hdisplay;
+    creq.height = drm_mode.vdisplay;
+    creq.bpp    = 32;
+    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+	perror("drm: create dumb buffer");
+	return -1;
+    }
+    buf->handle = creq.handle;
+    buf->pitch  = creq.pitch;
+    buf->size   = creq.size;
+
+    if (drmModeAddFB(drm_fd, drm_mode.hdisplay, drm_mode.vdisplay, 24, 32,
+		     buf->pitch, buf->handle, &buf->fb_id) < 0) {
+	perror("drm: add framebuffer");
+	goto err_destroy;
+    }
+
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.handle = buf->handle;
+    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq) < 0) {
+	perror("drm: map dumb buffer");
+	goto err_rmfb;
+    }
+    buf->mem = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    drm_fd, mreq.offset);
+    if (MAP_FAILED == buf->mem) {
+	perror("drm: mmap");
+	buf->mem = NULL;
+	goto err_rmfb;
+    }
+    memset(buf->mem, 0, buf->size);
+    return 0;
+
+ err_rmfb:
+    drmModeRmFB(drm_fd, buf->fb_id);
+ err_destroy:
+    memset(&dreq, 0, sizeof(dreq));
+    dreq.handle = buf->handle;
+    drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    memset(buf, 0, sizeof(*buf));
+    return -1;
+}
+
+static void drm_buf_destroy(struct drm_buf *buf)
+{
+    struct drm_mode_destroy_dumb dreq;
+
+    if (!buf->handle)
+	return;
+    if (buf->mem)
+	munmap(buf->mem, buf->size);
+    drmModeRmFB(drm_fd, buf->fb_id);
+    memset(&dreq, 0, sizeof(dreq));
+    dreq.handle = buf->handle;
+    drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int drm_show_buf(int page)
+{
+    if (drmModeSetCrtc(drm_fd, drm_crtc_id, drm_buf[page].fb_id, 0, 0,
+		       &drm_conn->connector_id, 1, &drm_mode) < 0) {
+	perror("drm: set crtc");
+	return -1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------- */
+/* page flipping                                                        */
+
+static void drm_page_flip_handler(int fd, unsigned int frame,
+				  unsigned int sec, unsigned int usec, void *data)
+{
+    drm_flip_pending = 0;
+}
+
+static void drm_wait_flip(void)
+{
+    drmEventContext ev;
+    struct pollfd pfd;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.version = DRM_EVENT_CONTEXT_VERSION;
+    ev.page_flip_handler = drm_page_flip_handler;
+    pfd.fd     = drm_fd;
+    pfd.events = POLLIN;
+
+    while (drm_flip_pending) {
+	int r = poll(&pfd, 1, 100);
+	if (r < 0 && errno == EINTR)
+	    continue;
+	if (r <= 0 || drmHandleEvent(drm_fd, &ev) < 0) {
+	    /* no event or broken fd, don't hang forever */
+	    drm_flip_pending = 0;
+	    break;
+	}
+    }
+}
+
+/* show the buffer drawn last (gfx->mem), then draw into the other one */
+static void drm_flush_display(bool second)
+{
+    int back = drm_page ^ 1;
+    uint8_t *mem;
+
+    drm_wait_flip();
+    if (0 == drmModePageFlip(drm_fd, drm_crtc_id, drm_buf[back].fb_id,
+			     DRM_MODE_PAGE_FLIP_EVENT, NULL)) {
+	drm_flip_pending = 1;
+	/* old buffer is scanned out until the flip is done */
+	drm_wait_flip();
+    } else if (0 != drm_show_buf(back)) {
+	return;
+    }
+    drm_page = back;
+
+    mem           = drm_gfx->mem;
+    drm_gfx->mem  = drm_gfx->mem2;
+    drm_gfx->mem2 = mem;
+}
+
+static void drm_restore_display(void)
+{
+    drm_flip_pending = 0;
+    drmSetMaster(drm_fd);
+    drm_show_buf(drm_page);
+}
+
+static void drm_cleanup_display(void)
+{
+    drm_wait_flip();
+    if (drm_ocrtc) {
+	drmModeSetCrtc(drm_fd, drm_ocrtc->crtc_id, drm_ocrtc->buffer_id,
+		       drm_ocrtc->x, drm_ocrtc->y,
+		       &drm_conn->connector_id, 1, &drm_ocrtc->mode);
+	drmModeFreeCrtc(drm_ocrtc);
+	drm_ocrtc = NULL;
+    }
+    drm_buf_destroy(&drm_buf[0]);
+    drm_buf_destroy(&drm_buf[1]);
+    if (drm_conn) {
+	drmModeFreeConnector(drm_conn);
+	drm_conn = NULL;
+    }
+    close(drm_fd);
+    drm_fd = -1;
+
+    console_restore_vt();
+    tcsetattr(STDIN_FILENO, TCSANOW, &term);
+}
+
+/* -------------------------------------------------------------------- */
+/* setup                                                                */
+
+static const char *conn_type[] = {
+    [ DRM_MODE_CONNECTOR_Unknown     ] = "unknown",
+    [ DRM_MODE_CONNECTOR_VGA         ] = "VGA",
+    [ DRM_MODE_CONNECTOR_DVII        ] = "DVI-I",
+    [ DRM_MODE_CONNECTOR_DVID        ] = "DVI-D",
+    [ DRM_MODE_CONNECTOR_DVIA        ] = "DVI-A",
+    [ DRM_MODE_CONNECTOR_Composite   ] = "Composite",
+    [ DRM_MODE_CONNECTOR_SVIDEO      ] = "SVIDEO",
+    [ DRM_MODE_CONNECTOR_LVDS        ] = "LVDS",
+    [ DRM_MODE_CONNECTOR_Component   ] = "Component",
+    [ DRM_MODE_CONNECTOR_9PinDIN     ] = "DIN",
+    [ DRM_MODE_CONNECTOR_DisplayPort ] = "DP",
+    [ DRM_MODE_CONNECTOR_HDMIA       ] = "HDMI-A",
+    [ DRM_MODE_CONNECTOR_HDMIB       ] = "HDMI-B",
+    [ DRM_MODE_CONNECTOR_TV          ] = "TV",
+    [ DRM_MODE_CONNECTOR_eDP         ] = "eDP",
+    [ DRM_MODE_CONNECTOR_VIRTUAL     ] = "Virtual",
+    [ DRM_MODE_CONNECTOR_DSI         ] = "DSI",
+};
+
+static const char *drm_conn_name(uint32_t type)
+{
+    if (type < sizeof(conn_type) / sizeof(conn_type[0]) && conn_type[type])
+	return conn_type[type];
+    return "unknown";
+}
+
+static int drm_open(const char *device)
+{
+    char name[32];
+    uint64_t dumb;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+	if (device) {
+	    snprintf(name, sizeof(name), "%s", device);
+	} else {
+	    snprintf(name, sizeof(name), DRM_DEV_NAME, DRM_DIR_NAME, i);
+	    if (-1 == access(name, F_OK))
+		break;
+	}
+	fprintf(stderr, "trying drm: %s ...\n", name);
+	drm_fd = open(name, O_RDWR | O_CLOEXEC);
+	if (drm_fd >= 0) {
+	    if (0 == drmGetCap(drm_fd, DRM_CAP_DUMB_BUFFER, &dumb) && dumb)
+		return 0;
+	    fprintf(stderr, "drm: %s: no dumb buffers\n", name);
+	    close(drm_fd);
+	    drm_fd = -1;
+	} else {
+	    fprintf(stderr, "open %s: %s\n", name, strerror(errno));
+	}
+	if (device)
+	    break;
+    }
+    return -1;
+}
+
+static int drm_find_output(const char *output, const char *mode)
+{
+    drmModeRes *res;
+    drmModeConnector *conn = NULL;
+    drmModeEncoder *enc;
+    char name[64] = "";
+    int i, j;
+
+    res = drmModeGetResources(drm_fd);
+    if (!res) {
+	perror("drm: get resources");
+	return -1;
+    }
+
+    /* connector: named one or first connected */
+    for (i = 0; i < res->count_connectors; i++) {
+	conn = drmModeGetConnector(drm_fd, res->connectors[i]);
+	if (!conn)
+	    continue;
+	snprintf(name, sizeof(name), "%s-%d",
+		 drm_conn_name(conn->connector_type),
+		 conn->connector_type_id);
+	if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes &&
+	    (!output || 0 == strcmp(name, output)))
+	    break;
+	drmModeFreeConnector(conn);
+	conn = NULL;
+    }
+    if (!conn) {
+	fprintf(stderr, "drm: no usable output found\n");
+	goto err;
+    }
+
+    /* mode: named one ("1280x720"), the preferred one or the first one */
+    drm_mode = conn->modes[0];
+    for (i = 0; i < conn->count_modes; i++) {
+	if (conn->modes[i].type & DRM_MODE_TYPE_PREFERRED) {
+	    drm_mode = conn->modes[i];
+	    break;
+	}
+    }
+    for (i = 0; mode && i < conn->count_modes; i++) {
+	if (0 == strcmp(conn->modes[i].name, mode)) {
+	    drm_mode = conn->modes[i];
+	    break;
+	}
+    }
+
+    /* crtc: the one in use or any the encoders can drive */
+    drm_crtc_id = 0;
+    if (conn->encoder_id) {
+	enc = drmModeGetEncoder(drm_fd, conn->encoder_id);
+	if (enc) {
+	    drm_crtc_id = enc->crtc_id;
+	    drmModeFreeEncoder(enc);
+	}
+    }
+    for (i = 0; !drm_crtc_id && i < conn->count_encoders; i++) {
+	enc = drmModeGetEncoder(drm_fd, conn->encoders[i]);
+	if (!enc)
+	    continue;
+	for (j = 0; j < res->count_crtcs; j++) {
+	    if (enc->possible_crtcs & (1 << j)) {
+		drm_crtc_id = res->crtcs[j];
+		break;
+	    }
+	}
+	drmModeFreeEncoder(enc);
+    }
+    if (!drm_crtc_id) {
+	fprintf(stderr, "drm: no crtc for output %s\n", name);
+	drmModeFreeConnector(conn);
+	goto err;
+    }
+
+    drm_conn = conn;
+    drmModeFreeResources(res);
+    return 0;
+
+ err:
+    drmModeFreeResources(res);
+    return -1;
+}
+
+gfxstate *drm_init(const char *device, const char *output, const char *mode, int vt)
+{
+    gfxstate *gfx;
+
+    if (drm_open(device) < 0)
+	return NULL;
+    if (drm_find_output(output, mode) < 0)
+	goto err_close;
+    if (drm_buf_create(&drm_buf[0]) < 0)
+	goto err_conn;
+    if (drm_buf_create(&drm_buf[1]) < 0)
+	goto err_buf;
+
+    if (vt != 0)
+	console_set_vt(vt);
+    tcgetattr(STDIN_FILENO, &term);
+
+    drm_ocrtc = drmModeGetCrtc(drm_fd, drm_crtc_id);
+    drm_page  = 0;
+    if (drm_show_buf(drm_page) < 0) {
+	drm_cleanup_display();
+	return NULL;
+    }
+    console_activate_current();
+
+    /* prepare gfx, draw into the hidden buffer */
+    gfx = malloc(sizeof(*gfx));
+    memset(gfx, 0, sizeof(*gfx));
+
+    gfx->hdisplay        = drm_mode.hdisplay;
+    gfx->vdisplay        = drm_mode.vdisplay;
+    gfx->stride          = drm_buf[0].pitch;
+    gfx->mem             = drm_buf[1].mem;
+    gfx->mem2            = drm_buf[0].mem;
+
+    /* XRGB8888 */
+    gfx->rlen            = 8;
+    gfx->glen            = 8;
+    gfx->blen            = 8;
+    gfx->tlen            = 0;
+    gfx->roff            = 16;
+    gfx->goff            = 8;
+    gfx->boff            = 0;
+    gfx->toff            = 0;
+    gfx->bits_per_pixel  = 32;
+
+    gfx->restore_display = drm_restore_display;
+    gfx->cleanup_display = drm_cleanup_display;
+    gfx->flush_display   = drm_flush_display;
+    drm_gfx = gfx;
+    return gfx;
+
+ err_buf:
+    drm_buf_destroy(&drm_buf[0]);
+ err_conn:
+    drmModeFreeConnector(drm_conn);
+    drm_conn = NULL;
+ err_close:
+    close(drm_fd);
+    drm_fd = -1;
+    return NULL;
+}
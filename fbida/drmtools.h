@@ -0,0 +1,3 @@
+#include "gfx.h"
+
+gfxstate *drm_init(const char *device, const char *output, const char *mode, int vt);
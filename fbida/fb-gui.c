@@ -2,6 +2,7 @@
 #include <stdlib.h>
 //#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
 //#include <math.h>
 //#include <wchar.h>
 //#include <inttypes.h>
@@ -12,9 +13,12 @@
 //#include <fontconfig/fcfreetype.h>
 //
 #include "vt.h"
+#include "readers.h"
 //#include "fbtools.h"
 //#include "dither.h"
 #include "fb-gui.h"
+#include "fb-simd.h"
+#include "../trace.h"
 //
 //static int ys =  3;
 //static int xs = 10;
@@ -24,8 +28,38 @@
 
 static int32_t s_lut_transp[256], s_lut_red[256], s_lut_green[256], s_lut_blue[256];
 
-static unsigned char **shadow;
-static unsigned int  *sdirty,swidth,sheight;
+static unsigned char *shadow;      /* RGB888, one block, sstride bytes per line */
+static unsigned int  sstride;
+static pixman_image_t *simage;      /* shadow wrapped for pixman */
+/* pixels x1 .. x2-1 of a line, empty if x1 >= x2 */
+struct shadow_span {
+    unsigned int x1, x2;
+};
+
+static unsigned int  swidth,sheight;
+
+static inline unsigned char *shadow_line(unsigned int y)
+{
+    return shadow + y * sstride;
+}
+static struct shadow_span *sdirty;  /* changed since last render */
+static struct shadow_span *sstale;  /* double buffering: outdated on the back page */
+static struct shadow_span *sused;   /* may be non-black, what a clear has to touch */
+
+static void span_add(struct shadow_span *s, unsigned int x1, unsigned int x2)
+{
+    if (x1 >= x2)
+    return;
+    if (s->x1 >= s->x2) {
+    s->x1 = x1;
+    s->x2 = x2;
+    return;
+    }
+    if (x1 < s->x1)
+    s->x1 = x1;
+    if (x2 > s->x2)
+    s->x2 = x2;
+}
 
 static void shadow_lut_init_one(int32_t *lut, int bits, int shift)
 {
@@ -47,7 +81,7 @@ static void shadow_lut_init(gfxstate *gfx)
     shadow_lut_init_one(s_lut_blue,   gfx->blen, gfx->boff);
 }
 
-static void shadow_render_line(gfxstate *gfx, int line,
+static void shadow_render_line(gfxstate *gfx, int line, unsigned int width,
                                unsigned char *dest, char unsigned *buffer)
 {
     uint8_t  *ptr  = (void*)dest;
@@ -55,27 +89,30 @@ static void shadow_render_line(gfxstate *gfx, int line,
     uint32_t *ptr4 = (void*)dest;
     int x;
 
+    if (0 == simd_pack_line(dest, buffer, width))
+    return;
+
     switch (gfx->bits_per_pixel) {
     case 8:
-//    dither_line(buffer, ptr, line, swidth);
+//    dither_line(buffer, ptr, line, width);
     break;
     case 15:
     case 16:
-    for (x = 0; x < swidth; x++) {
+    for (x = 0; x < width; x++) {
         ptr2[x] = s_lut_red[buffer[x*3]] |
         s_lut_green[buffer[x*3+1]] |
         s_lut_blue[buffer[x*3+2]];
     }
     break;
     case 24:
-    for (x = 0; x < swidth; x++) {
+    for (x = 0; x < width; x++) {
         ptr[3*x+2] = buffer[3*x+0];
         ptr[3*x+1] = buffer[3*x+1];
         ptr[3*x+0] = buffer[3*x+2];
     }
     break;
     case 32:
-    for (x = 0; x < swidth; x++) {
+    for (x = 0; x < width; x++) {
         ptr4[x] = s_lut_transp[255] |
         s_lut_red[buffer[x*3]] |
         s_lut_green[buffer[x*3+1]] |
@@ -90,29 +127,58 @@ static void shadow_render_line(gfxstate *gfx, int line,
 
 void shadow_render(gfxstate *gfx)
 {
+    unsigned int bytes = (gfx->bits_per_pixel + 7) / 8;
     unsigned int offset = 0;
+    struct shadow_span span;
     int i;
 
     if (!console_visible)
     return;
     for (i = 0; i < sheight; i++, offset += gfx->stride) {
-    if (0 == sdirty[i])
+    span = sdirty[i];
+    span_add(&span, sstale[i].x1, sstale[i].x2);
+    if (span.x1 >= span.x2)
         continue;
-    shadow_render_line(gfx, i, gfx->mem + offset, shadow[i]);
-    sdirty[i] = 0;
+    shadow_render_line(gfx, i, span.x2 - span.x1,
+                       gfx->mem + offset + span.x1 * bytes,
+                       shadow_line(i) + span.x1 * 3);
+    /* the page shown until now needs the pixels after the flip too */
+    if (gfx->mem2)
+        sstale[i] = sdirty[i];
+    else
+        sstale[i].x1 = sstale[i].x2 = 0;
+    sdirty[i].x1 = sdirty[i].x2 = 0;
     }
+    trace_mark(trace_render);
     if (gfx->flush_display)
         gfx->flush_display(false);
+    trace_mark(trace_flip);
 }
 
 void shadow_clear_lines(int first, int last)
 {
     int i;
 
+    int run = first;
+
+    /* black pixels stay as they are, full lines are cleared in one go */
     for (i = first; i <= last; i++) {
-	memset(shadow[i],0,3*swidth);
-	sdirty[i]++;
+	if (sused[i].x1 == 0 && sused[i].x2 == swidth) {
+	    span_add(&sdirty[i], 0, swidth);
+	    sused[i].x2 = 0;
+	    continue;
+	}
+	if (run < i)
+	    memset(shadow_line(run), 0, (i - run) * sstride);
+	run = i + 1;
+	if (sused[i].x1 >= sused[i].x2)
+	    continue;
+	memset(shadow_line(i) + 3*sused[i].x1, 0, 3*(sused[i].x2 - sused[i].x1));
+	span_add(&sdirty[i], sused[i].x1, sused[i].x2);
+	sused[i].x1 = sused[i].x2 = 0;
     }
+    if (run <= last)
+	memset(shadow_line(run), 0, (last + 1 - run) * sstride);
 }
 
 void shadow_clear(void)
@@ -125,7 +191,7 @@ void shadow_set_dirty(void)
     int i;
 
     for (i = 0; i < sheight; i++)
-    sdirty[i]++;
+    span_add(&sdirty[i], 0, swidth);
 }
 
 void shadow_init(gfxstate *gfx)
@@ -135,11 +201,20 @@ void shadow_init(gfxstate *gfx)
     /* init shadow fb */
     swidth  = gfx->hdisplay;
     sheight = gfx->vdisplay;
-    shadow  = malloc(sizeof(unsigned char*) * sheight);
-    sdirty  = malloc(sizeof(unsigned int)   * sheight);
-    memset(sdirty,0, sizeof(unsigned int)   * sheight);
+    /* 64 byte aligned lines for vector loads */
+    sstride = (swidth * 3 + 63) & ~63;
+    if (0 != posix_memalign((void **)&shadow, 64, sstride * sheight)) {
+    fprintf(stderr, "Oops: no memory for shadow framebuffer\n");
+    exit(-1);
+    }
+    simage  = pixman_image_create_bits(PIXMAN_r8g8b8, swidth, sheight,
+                                       (uint32_t *)shadow, sstride);
+    sdirty  = calloc(sheight, sizeof(struct shadow_span));
+    sstale  = calloc(sheight, sizeof(struct shadow_span));
+    sused   = calloc(sheight, sizeof(struct shadow_span));
+    /* unknown content, the first clear covers everything */
     for (i = 0; i < sheight; i++)
-    shadow[i] = malloc(swidth*3);
+    sused[i].x2 = swidth;
     shadow_clear();
 
     /* init rendering */
@@ -153,6 +228,7 @@ void shadow_init(gfxstate *gfx)
     case 24:
     case 32:
         shadow_lut_init(gfx);
+        simd_init(gfx, simd_detect());
     break;
     default:
     fprintf(stderr, "Oops: %i bit/pixel ???\n",
@@ -163,14 +239,114 @@ void shadow_init(gfxstate *gfx)
 
 void shadow_fini(void)
 {
-    int i;
-
     if (!shadow)
     return;
-    for (i = 0; i < sheight; i++)
-    free(shadow[i]);
+    pixman_image_unref(simage);
+    simage = NULL;
     free(shadow);
+    shadow = NULL;
     free(sdirty);
+    free(sstale);
+    free(sused);
+}
+
+/* ---------------------------------------------------------------------- */
+/* native images -- already converted to framebuffer format               */
+
+struct gfx_image *shadow_convert_image(gfxstate *gfx, struct ida_image *img)
+{
+    struct gfx_image *gimg;
+    unsigned int bytes = (gfx->bits_per_pixel + 7) / 8;
+    unsigned int y;
+
+    if (gfx->bits_per_pixel == 8)
+    return NULL; /* no dithering for native images */
+
+    gimg = malloc(sizeof(*gimg));
+    if (NULL == gimg)
+    return NULL;
+    memset(gimg, 0, sizeof(*gimg));
+
+    /* only the visible part, see shadow_draw_image() */
+    gimg->width  = img->i.width  < gfx->hdisplay ? img->i.width  : gfx->hdisplay;
+    gimg->height = img->i.height < gfx->vdisplay ? img->i.height : gfx->vdisplay;
+    if (gimg->width == gfx->hdisplay)
+    gimg->stride = gfx->stride; /* allows one memcpy, see shadow_draw_native() */
+    else
+    gimg->stride = (gimg->width * bytes + 3) & ~3;
+    gimg->data   = malloc(gimg->stride * gimg->height);
+    if (NULL == gimg->data) {
+    free(gimg);
+    return NULL;
+    }
+
+    for (y = 0; y < gimg->height; y++)
+    shadow_render_line(gfx, y, gimg->width, gimg->data + y * gimg->stride,
+                       ida_image_scanline(img, y));
+    return gimg;
+}
+
+static void shadow_fill_native(gfxstate *gfx, uint8_t *dest, unsigned int pixels)
+{
+    uint32_t *ptr4 = (void*)dest;
+    unsigned int x;
+
+    if (gfx->bits_per_pixel == 32 && s_lut_transp[255]) {
+    for (x = 0; x < pixels; x++)
+        ptr4[x] = s_lut_transp[255];
+    } else {
+    memset(dest, 0, pixels * ((gfx->bits_per_pixel + 7) / 8));
+    }
+}
+
+void shadow_draw_native(gfxstate *gfx, struct gfx_image *gimg)
+{
+    unsigned int bytes = (gfx->bits_per_pixel + 7) / 8;
+    unsigned int xs, ys, y;
+    uint8_t *dest;
+
+    if (!console_visible)
+    return;
+
+    /* center image, same as shadow_draw_image() */
+    xs = (gfx->hdisplay - gimg->width)  / 2;
+    ys = (gfx->vdisplay - gimg->height) / 2;
+
+    for (y = 0, dest = gfx->mem; y < gfx->vdisplay; y++, dest += gfx->stride) {
+    if (y < ys || y >= ys + gimg->height) {
+        shadow_fill_native(gfx, dest, gfx->hdisplay);
+        continue;
+    }
+    if (gimg->stride == gfx->stride && gimg->width == gfx->hdisplay) {
+        /* same layout as the framebuffer, copy all lines at once */
+        memcpy(dest, gimg->data, gimg->stride * gimg->height);
+        y    += gimg->height - 1;
+        dest += gfx->stride * (gimg->height - 1);
+        continue;
+    }
+    shadow_fill_native(gfx, dest, xs);
+    memcpy(dest + xs * bytes, gimg->data + (y - ys) * gimg->stride,
+           gimg->width * bytes);
+    shadow_fill_native(gfx, dest + (xs + gimg->width) * bytes,
+                       gfx->hdisplay - xs - gimg->width);
+    }
+    /* screen no longer shows the shadow buffer */
+    shadow_set_dirty();
+    trace_mark(trace_draw);
+    if (gfx->flush_display)
+        gfx->flush_display(false);
+    trace_mark(trace_flip);
+}
+
+void gfx_image_free(struct gfx_image *gimg)
+{
+    if (!gimg)
+    return;
+    if (gimg->map)
+    munmap(gimg->map, gimg->maplen);
+    else
+    free(gimg->data);
+    free(gimg);
 }
 
 ///* ---------------------------------------------------------------------- */
@@ -229,30 +405,89 @@ void shadow_fini(void)
 
 void shadow_draw_rgbdata(int x, int y, int pixels, unsigned char *rgb)
 {
-    unsigned char *dest = shadow[y] + 3*x;
+    unsigned char *dest = shadow_line(y) + 3*x;
 
     memcpy(dest,rgb,3*pixels);
-    sdirty[y]++;
+    span_add(&sdirty[y], x, x + pixels);
+    span_add(&sused[y], x, x + pixels);
+}
+
+/* solid mask with the given opacity, for blending via pixman */
+static pixman_image_t *shadow_weight_mask(int percent)
+{
+    pixman_color_t color = { 0, 0, 0, percent * 0xffff / 100 };
+
+    return pixman_image_create_solid_fill(&color);
+}
+
+static void shadow_mark(int x, int y, int width, int height)
+{
+    int i;
+
+    for (i = y; i < y + height; i++) {
+    span_add(&sdirty[i], x, x + width);
+    span_add(&sused[i], x, x + width);
+    }
+}
+
+void shadow_composite(struct ida_image *img, int sx, int sy, int dx, int dy,
+                      int width, int height, int weight)
+{
+    pixman_image_t *mask = NULL;
+
+    /* clip to the shadow buffer */
+    if (dx < 0)
+    width += dx, sx -= dx, dx = 0;
+    if (dy < 0)
+    height += dy, sy -= dy, dy = 0;
+    if (dx + width > swidth)
+    width = swidth - dx;
+    if (dy + height > sheight)
+    height = sheight - dy;
+    if (width <= 0 || height <= 0)
+    return;
+
+    /* same byte layout on both sides, pixman's channel naming does not matter */
+    if (weight < 100)
+    mask = shadow_weight_mask(weight);
+    pixman_image_composite32(mask ? PIXMAN_OP_ADD : PIXMAN_OP_SRC,
+                             img->p, mask, simage,
+                             sx, sy, 0, 0, dx, dy, width, height);
+    if (mask)
+    pixman_image_unref(mask);
+    shadow_mark(dx, dy, width, height);
 }
 
 void shadow_merge_rgbdata(int x, int y, int pixels, int weight,
               unsigned char *rgb)
 {
-    unsigned char *dest = shadow[y] + 3*x;
-    int i = 3*pixels;
+    pixman_image_t *src, *mask;
+
+    src  = pixman_image_create_bits(PIXMAN_r8g8b8, pixels, 1, (uint32_t *)rgb,
+                                    (3 * pixels + 3) & ~3);
+    mask = shadow_weight_mask(weight);
+    pixman_image_composite32(PIXMAN_OP_ADD, src, mask, simage,
+                             0, 0, 0, 0, x, y, pixels, 1);
+    pixman_image_unref(mask);
+    pixman_image_unref(src);
+    shadow_mark(x, y, pixels, 1);
+}
 
-    weight = weight * 256 / 100;
+/* part of [x1,x2) that may be non-black */
+static struct shadow_span shadow_used(int y, int x1, int x2)
+{
+    struct shadow_span span;
 
-    while (i-- > 0)
-    *(dest++) += *(rgb++) * weight >> 8;
-    sdirty[y]++;
+    span.x1 = x1 > sused[y].x1 ? x1 : sused[y].x1;
+    span.x2 = x2 < sused[y].x2 ? x2 : sused[y].x2;
+    return span;
 }
 
-
 void shadow_darkify(int x1, int x2, int y1,int y2, int percent)
 {
-    unsigned char *ptr;
-    int x,y,h;
+    pixman_image_t *black;
+    struct shadow_span span;
+    int y,h;
 
     if (x2 < x1)
 	h = x2, x2 = x1, x1 = h;
@@ -262,25 +497,32 @@ void shadow_darkify(int x1, int x2, int y1,int y2, int percent)
     if (x1 < 0)
 	x1 = 0;
     if (x2 >= swidth)
-	x2 = swidth;
+	x2 = swidth-1;
 
     if (y1 < 0)
 	y1 = 0;
     if (y2 >= sheight)
-	y2 = sheight;
-
-    percent = percent * 256 / 100;
-
-    for (y = y1; y <= y2; y++) {
-	sdirty[y]++;
-	ptr = shadow[y];
-	ptr += 3*x1;
-	x = 3*(x2-x1+1);
-	while (x-- > 0) {
-	    *ptr = (*ptr * percent) >> 8;
-	    ptr++;
+	y2 = sheight-1;
+
+    /* black over the area with opacity 100 - percent,
+     * black pixels stay black, so only the used spans are touched,
+     * lines with the same span are done in one call */
+    black = shadow_weight_mask(100 - percent);
+    for (y = y1; y <= y2; y = h) {
+	span = shadow_used(y, x1, x2+1);
+	for (h = y+1; h <= y2; h++) {
+	    struct shadow_span next = shadow_used(h, x1, x2+1);
+	    if (next.x1 != span.x1 || next.x2 != span.x2)
+		break;
 	}
+	if (span.x1 >= span.x2)
+	    continue;
+	pixman_image_composite32(PIXMAN_OP_OVER, black, NULL, simage,
+				 0, 0, 0, 0, span.x1, y, span.x2 - span.x1, h - y);
+	for (; y < h; y++)
+	    span_add(&sdirty[y], span.x1, span.x2);
     }
+    pixman_image_unref(black);
 }
 
 //void shadow_reverse(int x1, int x2, int y1,int y2)
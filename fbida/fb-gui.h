@@ -1,3 +1,7 @@
+#ifndef _FB_GUI_H_
+#define _FB_GUI_H_
+
+#include <stddef.h>
 #include "gfx.h"
 //#include <ft2build.h>
 //#include FT_FREETYPE_H
@@ -20,6 +24,24 @@ void shadow_draw_rgbdata(int x, int y, int pixels,
 void shadow_merge_rgbdata(int x, int y, int pixels, int weight,
               unsigned char *rgb);
 void shadow_darkify(int x1, int x2, int y1,int y2, int percent);
+struct ida_image;
+/* copy (weight 100) or add weighted part of an image area to the shadow */
+void shadow_composite(struct ida_image *img, int sx, int sy, int dx, int dy,
+                      int width, int height, int weight);
+
+/* image already converted to the framebuffer pixel format */
+struct gfx_image {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint8_t  *data;
+    void     *map;      /* mmap()ed area holding data or NULL if malloc()ed */
+    size_t   maplen;
+};
+
+struct gfx_image *shadow_convert_image(gfxstate *gfx, struct ida_image *img);
+void shadow_draw_native(gfxstate *gfx, struct gfx_image *gimg);
+void gfx_image_free(struct gfx_image *gimg);
 //void shadow_reverse(int x1, int x2, int y1,int y2);
 //
 //int  shadow_draw_string(FT_Face face, int x, int y, wchar_t *str, int align);
@@ -30,3 +52,5 @@ void shadow_darkify(int x1, int x2, int y1,int y2, int percent);
 //void font_init(void);
 //FT_Face font_open(char *fcname);
 //
+
+#endif // _FB_GUI_H_
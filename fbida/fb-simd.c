@@ -0,0 +1,392 @@
+/*
+ * vectorised pixel packing for shadow_render_line()
+ *
+ * Every kernel gives exactly the same result as the lookup tables
+ * in fb-gui.c, formats the tables handle differently get no kernel.
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define SIMD_X86 1
+#endif
+#if defined(__ARM_NEON)
+# include <arm_neon.h>
+# define SIMD_ARM 1
+#endif
+
+#include "fb-simd.h"
+
+typedef void (*simd_pack_fn)(uint8_t *dest, const uint8_t *rgb, unsigned int pixels);
+
+static struct {
+    simd_pack_fn pack;
+    uint32_t     alpha;         /* 32 bpp: transparency bits */
+    int          byte[3];       /* 32 bpp: dest byte of r, g, b */
+    int          shr[3], shl[3];/* 16 bpp: (c >> shr) << shl for r, g, b */
+#ifdef SIMD_X86
+    uint8_t      shuf32[16];
+    uint8_t      shuf24[16];
+    uint8_t      shuf16lo[3][16];
+    uint8_t      shuf16hi[3][16];
+#endif
+} p;
+
+/* ---------------------------------------------------------------------- */
+/* scalar versions, used for the tail of every line                       */
+
+static void pack32_c(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    uint32_t *ptr4 = (void*)dest;
+    unsigned int x;
+
+    for (x = 0; x < pixels; x++)
+    ptr4[x] = p.alpha |
+        (uint32_t)rgb[3*x+0] << (8 * p.byte[0]) |
+        (uint32_t)rgb[3*x+1] << (8 * p.byte[1]) |
+        (uint32_t)rgb[3*x+2] << (8 * p.byte[2]);
+}
+
+static void pack24_c(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    unsigned int x;
+
+    for (x = 0; x < pixels; x++) {
+    dest[3*x+2] = rgb[3*x+0];
+    dest[3*x+1] = rgb[3*x+1];
+    dest[3*x+0] = rgb[3*x+2];
+    }
+}
+
+static void pack16_c(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    uint16_t *ptr2 = (void*)dest;
+    unsigned int x;
+
+    for (x = 0; x < pixels; x++)
+    ptr2[x] = (rgb[3*x+0] >> p.shr[0]) << p.shl[0] |
+        (rgb[3*x+1] >> p.shr[1]) << p.shl[1] |
+        (rgb[3*x+2] >> p.shr[2]) << p.shl[2];
+}
+
+/* ---------------------------------------------------------------------- */
+/* x86: SSSE3 + AVX2                                                      */
+
+#ifdef SIMD_X86
+
+__attribute__((target("ssse3")))
+static void pack32_ssse3(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    const __m128i mask  = _mm_loadu_si128((const __m128i*)p.shuf32);
+    const __m128i alpha = _mm_set1_epi32(p.alpha);
+    unsigned int x;
+
+    /* 4 pixels per step, the load reads 16 of 12 bytes */
+    for (x = 0; x + 6 <= pixels; x += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(rgb + 3*x));
+    v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+    _mm_storeu_si128((__m128i*)(dest + 4*x), v);
+    }
+    pack32_c(dest + 4*x, rgb + 3*x, pixels - x);
+}
+
+__attribute__((target("avx2")))
+static void pack32_avx2(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    const __m256i mask  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p.shuf32));
+    const __m256i alpha = _mm256_set1_epi32(p.alpha);
+    unsigned int x;
+
+    /* 8 pixels per step, 4 in every 128 bit lane */
+    for (x = 0; x + 10 <= pixels; x += 8) {
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(rgb + 3*x))),
+        _mm_loadu_si128((const __m128i*)(rgb + 3*x + 12)), 1);
+    v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+    _mm256_storeu_si256((__m256i*)(dest + 4*x), v);
+    }
+    pack32_ssse3(dest + 4*x, rgb + 3*x, pixels - x);
+}
+
+__attribute__((target("ssse3")))
+static void pack24_ssse3(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    const __m128i mask = _mm_loadu_si128((const __m128i*)p.shuf24);
+    unsigned int x;
+
+    /* 5 pixels per step, the 16th byte is overwritten by the next step */
+    for (x = 0; x + 6 <= pixels; x += 5) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(rgb + 3*x));
+    _mm_storeu_si128((__m128i*)(dest + 3*x), _mm_shuffle_epi8(v, mask));
+    }
+    pack24_c(dest + 3*x, rgb + 3*x, pixels - x);
+}
+
+__attribute__((target("ssse3")))
+static void pack16_ssse3(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    __m128i mlo[3], mhi[3];
+    unsigned int x;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+    mlo[c] = _mm_loadu_si128((const __m128i*)p.shuf16lo[c]);
+    mhi[c] = _mm_loadu_si128((const __m128i*)p.shuf16hi[c]);
+    }
+
+    /* 8 pixels per step, from the 24 bytes at rgb+0..15 and rgb+8..23 */
+    for (x = 0; x + 8 <= pixels; x += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)(rgb + 3*x));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(rgb + 3*x + 8));
+    __m128i out = _mm_setzero_si128();
+    for (c = 0; c < 3; c++) {
+        __m128i v = _mm_or_si128(_mm_shuffle_epi8(lo, mlo[c]),
+                                 _mm_shuffle_epi8(hi, mhi[c]));
+        v = _mm_srl_epi16(v, _mm_cvtsi32_si128(p.shr[c]));
+        v = _mm_sll_epi16(v, _mm_cvtsi32_si128(p.shl[c]));
+        out = _mm_or_si128(out, v);
+    }
+    _mm_storeu_si128((__m128i*)(dest + 2*x), out);
+    }
+    pack16_c(dest + 2*x, rgb + 3*x, pixels - x);
+}
+
+__attribute__((target("avx2")))
+static void pack16_avx2(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    __m256i mlo[3], mhi[3];
+    unsigned int x;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+    mlo[c] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p.shuf16lo[c]));
+    mhi[c] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p.shuf16hi[c]));
+    }
+
+    /* 16 pixels per step, 8 in every 128 bit lane */
+    for (x = 0; x + 16 <= pixels; x += 16) {
+    const uint8_t *src = rgb + 3*x;
+    __m256i lo = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src))),
+        _mm_loadu_si128((const __m128i*)(src + 24)), 1);
+    __m256i hi = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + 8))),
+        _mm_loadu_si128((const __m128i*)(src + 32)), 1);
+    __m256i out = _mm256_setzero_si256();
+    for (c = 0; c < 3; c++) {
+        __m256i v = _mm256_or_si256(_mm256_shuffle_epi8(lo, mlo[c]),
+                                    _mm256_shuffle_epi8(hi, mhi[c]));
+        v = _mm256_srl_epi16(v, _mm_cvtsi32_si128(p.shr[c]));
+        v = _mm256_sll_epi16(v, _mm_cvtsi32_si128(p.shl[c]));
+        out = _mm256_or_si256(out, v);
+    }
+    _mm256_storeu_si256((__m256i*)(dest + 2*x), out);
+    }
+    pack16_ssse3(dest + 2*x, rgb + 3*x, pixels - x);
+}
+
+static void simd_init_x86(void)
+{
+    int i, k, c;
+
+    /* 32 bpp: 4 pixels, byte k of pixel i gets its channel or zero */
+    for (i = 0; i < 4; i++)
+    for (k = 0; k < 4; k++) {
+        p.shuf32[4*i+k] = 0x80;
+        for (c = 0; c < 3; c++)
+        if (p.byte[c] == k)
+            p.shuf32[4*i+k] = 3*i + c;
+    }
+
+    /* 24 bpp: 5 pixels, swap r and b */
+    for (i = 0; i < 5; i++) {
+    p.shuf24[3*i+0] = 3*i+2;
+    p.shuf24[3*i+1] = 3*i+1;
+    p.shuf24[3*i+2] = 3*i+0;
+    }
+    p.shuf24[15] = 15;
+
+    /* 16 bpp: channel c of 8 pixels to 16 bit lanes,
+     * pixels 0..4 from the 1st load, 5..7 from the 2nd (8 bytes later) */
+    for (c = 0; c < 3; c++)
+    for (i = 0; i < 8; i++) {
+        p.shuf16lo[c][2*i]   = i < 5 ? 3*i + c : 0x80;
+        p.shuf16lo[c][2*i+1] = 0x80;
+        p.shuf16hi[c][2*i]   = i < 5 ? 0x80 : 3*i + c - 8;
+        p.shuf16hi[c][2*i+1] = 0x80;
+    }
+}
+
+#endif /* SIMD_X86 */
+
+/* ---------------------------------------------------------------------- */
+/* arm: NEON                                                              */
+
+#ifdef SIMD_ARM
+
+static void pack32_neon(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    unsigned int x;
+    int k, c;
+
+    for (x = 0; x + 16 <= pixels; x += 16) {
+    uint8x16x3_t v = vld3q_u8(rgb + 3*x);
+    uint8x16x4_t o;
+    for (k = 0; k < 4; k++) {
+        o.val[k] = vdupq_n_u8((p.alpha >> (8*k)) & 0xff);
+        for (c = 0; c < 3; c++)
+        if (p.byte[c] == k)
+            o.val[k] = vorrq_u8(o.val[k], v.val[c]);
+    }
+    vst4q_u8(dest + 4*x, o);
+    }
+    pack32_c(dest + 4*x, rgb + 3*x, pixels - x);
+}
+
+static void pack24_neon(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    unsigned int x;
+
+    for (x = 0; x + 16 <= pixels; x += 16) {
+    uint8x16x3_t v = vld3q_u8(rgb + 3*x);
+    uint8x16_t   t = v.val[0];
+    v.val[0] = v.val[2];
+    v.val[2] = t;
+    vst3q_u8(dest + 3*x, v);
+    }
+    pack24_c(dest + 3*x, rgb + 3*x, pixels - x);
+}
+
+static void pack16_neon(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    uint16_t *ptr2 = (void*)dest;
+    unsigned int x;
+    int c;
+
+    for (x = 0; x + 16 <= pixels; x += 16) {
+    uint8x16x3_t v = vld3q_u8(rgb + 3*x);
+    uint16x8_t lo = vdupq_n_u16(0);
+    uint16x8_t hi = vdupq_n_u16(0);
+    for (c = 0; c < 3; c++) {
+        int16x8_t shr = vdupq_n_s16(-p.shr[c]);
+        int16x8_t shl = vdupq_n_s16(p.shl[c]);
+        lo = vorrq_u16(lo, vshlq_u16(vshlq_u16(vmovl_u8(vget_low_u8(v.val[c])), shr), shl));
+        hi = vorrq_u16(hi, vshlq_u16(vshlq_u16(vmovl_u8(vget_high_u8(v.val[c])), shr), shl));
+    }
+    vst1q_u16(ptr2 + x, lo);
+    vst1q_u16(ptr2 + x + 8, hi);
+    }
+    pack16_c(dest + 2*x, rgb + 3*x, pixels - x);
+}
+
+#endif /* SIMD_ARM */
+
+/* ---------------------------------------------------------------------- */
+
+enum simd_level simd_detect(void)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+    return SIMD_SSSE3;
+#endif
+#ifdef SIMD_ARM
+    return SIMD_NEON;
+#endif
+    return SIMD_NONE;
+}
+
+static int simd_fmt32(gfxstate *gfx)
+{
+    if (gfx->rlen != 8 || gfx->glen != 8 || gfx->blen != 8)
+    return 0;
+    if (gfx->roff % 8 || gfx->goff % 8 || gfx->boff % 8)
+    return 0;
+    if (gfx->roff > 24 || gfx->goff > 24 || gfx->boff > 24)
+    return 0;
+    if (gfx->roff == gfx->goff || gfx->roff == gfx->boff || gfx->goff == gfx->boff)
+    return 0;
+    return 1;
+}
+
+static int simd_fmt16(gfxstate *gfx)
+{
+    if (gfx->rlen > 8 || gfx->glen > 8 || gfx->blen > 8)
+    return 0;
+    if (gfx->roff + gfx->rlen > 16 || gfx->goff + gfx->glen > 16 || gfx->boff + gfx->blen > 16)
+    return 0;
+    return 1;
+}
+
+enum simd_level simd_init(gfxstate *gfx, enum simd_level level)
+{
+    memset(&p, 0, sizeof(p));
+
+    p.byte[0] = gfx->roff / 8;
+    p.byte[1] = gfx->goff / 8;
+    p.byte[2] = gfx->boff / 8;
+    p.shr[0] = 8 - gfx->rlen; p.shl[0] = gfx->roff;
+    p.shr[1] = 8 - gfx->glen; p.shl[1] = gfx->goff;
+    p.shr[2] = 8 - gfx->blen; p.shl[2] = gfx->boff;
+    /* same as s_lut_transp[255] */
+    if (gfx->tlen > 8)
+    p.alpha = 255u << (gfx->tlen + gfx->toff - 8);
+    else
+    p.alpha = (255u >> (8 - gfx->tlen)) << gfx->toff;
+
+    switch (level) {
+#ifdef SIMD_X86
+    case SIMD_AVX2:
+    case SIMD_SSSE3:
+    simd_init_x86();
+    switch (gfx->bits_per_pixel) {
+    case 15:
+    case 16:
+        if (simd_fmt16(gfx))
+        p.pack = level == SIMD_AVX2 ? pack16_avx2 : pack16_ssse3;
+        break;
+    case 24:
+        p.pack = pack24_ssse3;
+        break;
+    case 32:
+        if (simd_fmt32(gfx))
+        p.pack = level == SIMD_AVX2 ? pack32_avx2 : pack32_ssse3;
+        break;
+    }
+    break;
+#endif
+#ifdef SIMD_ARM
+    case SIMD_NEON:
+    switch (gfx->bits_per_pixel) {
+    case 15:
+    case 16:
+        if (simd_fmt16(gfx))
+        p.pack = pack16_neon;
+        break;
+    case 24:
+        p.pack = pack24_neon;
+        break;
+    case 32:
+        if (simd_fmt32(gfx))
+        p.pack = pack32_neon;
+        break;
+    }
+    break;
+#endif
+    default:
+    break;
+    }
+
+    return p.pack ? level : SIMD_NONE;
+}
+
+int simd_pack_line(uint8_t *dest, const uint8_t *rgb, unsigned int pixels)
+{
+    if (!p.pack)
+    return -1;
+    p.pack(dest, rgb, pixels);
+    return 0;
+}
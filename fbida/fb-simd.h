@@ -0,0 +1,25 @@
+#ifndef _FB_SIMD_H_
+#define _FB_SIMD_H_
+
+#include "gfx.h"
+
+/* vectorised RGB888 -> framebuffer format line packing */
+
+enum simd_level {
+    SIMD_NONE,
+    SIMD_SSSE3,
+    SIMD_AVX2,
+    SIMD_NEON,
+};
+
+/* best level the cpu supports */
+enum simd_level simd_detect(void);
+
+/* pick a kernel for the gfx pixel format, returns the level used
+ * (SIMD_NONE if there is no kernel for the format or level) */
+enum simd_level simd_init(gfxstate *gfx, enum simd_level level);
+
+/* pack one line, returns -1 if no kernel is selected */
+int simd_pack_line(uint8_t *dest, const uint8_t *rgb, unsigned int pixels);
+
+#endif // _FB_SIMD_H_
@@ -5,6 +5,8 @@
  *
  */
 
+#define _GNU_SOURCE	/* pipe2() */
+
 //#include <stdio.h>
 #include <stdlib.h>
 //#include <stdbool.h>
@@ -12,7 +14,7 @@
 #include <string.h>
 #include <unistd.h>
 //#include <time.h>
-//#include <fcntl.h>
+#include <fcntl.h>
 #include <errno.h>
 //#include <termios.h>
 //#include <math.h>
@@ -43,6 +45,7 @@
 //#include "fbtools.h"
 //#include "drmtools.h"
 #include "fb-gui.h"
+#include "../trace.h"
 //#include "filter.h"
 //#include "desktop.h"
 //#include "fbiconfig.h"
@@ -320,16 +323,14 @@ shadow_draw_image(gfxstate *gfx, struct ida_image *img, int xoff, int yoff,
 {
     unsigned int     dwidth  = MIN(img->i.width,  gfx->hdisplay);
     unsigned int     dheight = MIN(img->i.height, gfx->vdisplay);
-    unsigned int     data, offset, y, xs, ys;
+    unsigned int     xs, ys;
+    int              y0, y1;
 
     if (100 == weight)
     shadow_clear_lines(first, last);
     else
     shadow_darkify(0, gfx->hdisplay-1, first, last, 100 - weight);
 
-    /* offset for image data (image > screen, select visible area) */
-    offset = (yoff * img->i.width + xoff) * 3;
-
     /* offset for video memory (image < screen, center image) */
     xs = 0, ys = 0;
     if (img->i.width < gfx->hdisplay)
@@ -337,22 +338,20 @@ shadow_draw_image(gfxstate *gfx, struct ida_image *img, int xoff, int yoff,
     if (img->i.height < gfx->vdisplay)
     ys += (gfx->vdisplay - img->i.height) / 2;
 
-    /* go ! */
-    for (data = 0, y = 0;
-     data < img->i.width * img->i.height * 3
-         && data / img->i.width / 3 < dheight;
-     data += img->i.width * 3, y++) {
-    if (ys+y < first)
-        continue;
-    if (ys+y > last)
-        continue;
-    if (100 == weight)
-      shadow_draw_rgbdata(xs, ys+y, dwidth,
-                  ida_image_scanline(img, y) + offset);
-    else
-      shadow_merge_rgbdata(xs, ys+y, dwidth, weight,
-                               ida_image_scanline(img, y) + offset);
-    }
+    /* image lines within first .. last */
+    y0 = (int)first - (int)ys;
+    y1 = (int)last  - (int)ys;
+    if (y0 < 0)
+    y0 = 0;
+    if (y1 > (int)dheight - 1)
+    y1 = (int)dheight - 1;
+    if (y0 > y1)
+    return;
+
+    /* go ! (xoff/yoff select the visible area if image > screen) */
+    shadow_composite(img, xoff, yoff + y0, xs, ys + y0,
+                     dwidth, y1 - y0 + 1, weight);
+    trace_mark(trace_draw);
 }
 
 //static void status_prepare(void)
@@ -542,15 +541,15 @@ void free_image(struct ida_image *img)
 {
     if (img) {
     if (img->p) {
-        img_mem -= img->i.width * img->i.height * 3;
+        __sync_sub_and_fetch(&img_mem, img->i.width * img->i.height * 3);
         ida_image_free(img);
     }
     free(img);
     }
 }
 
-struct ida_image*
-read_image(char *filename)
+static struct ida_image*
+do_read_image(char *filename, int console_check)
 {
     struct ida_loader *loader = NULL;
     struct ida_image *img;
@@ -582,7 +581,8 @@ read_image(char *filename)
     /* no loader found, try to use ImageMagick's convert */
     int p[2];
 
-    if (0 != pipe(p))
+    /* close on exec, other threads may fork at the same time */
+    if (0 != pipe2(p, O_CLOEXEC))
         return NULL;
     switch (fork()) {
     case -1: /* error */
@@ -592,15 +592,16 @@ read_image(char *filename)
         return NULL;
     case 0: /* child */
         dup2(p[1], 1 /* stdout */);
-        close(p[0]);
-        close(p[1]);
         execlp("convert", "convert", "-depth", "8", filename, "ppm:-", NULL);
-        exit(-1);
+        /* no atexit handlers and stdio flushing of the parent's copy */
+        _exit(-1);
     default: /* parent */
         close(p[1]);
         fp = fdopen(p[0], "r");
-        if (NULL == fp)
+        if (NULL == fp) {
+        close(p[0]);
         return NULL;
+        }
         loader = &ppm_loader;
     }
     }
@@ -615,15 +616,124 @@ read_image(char *filename)
     return NULL;
     }
     ida_image_alloc(img);
-    img_mem += img->i.width * img->i.height * 3;
+    __sync_add_and_fetch(&img_mem, img->i.width * img->i.height * 3);
     for (y = 0; y < img->i.height; y++) {
-        check_console_switch();
+        if (console_check)
+            check_console_switch();
     loader->read(ida_image_scanline(img, y), y, data);
     }
     loader->done(data);
     return img;
 }
 
+struct ida_image*
+read_image(char *filename)
+{
+    return do_read_image(filename, 1);
+}
+
+struct ida_image*
+read_image_bg(char *filename)
+{
+    return do_read_image(filename, 0);
+}
+
+struct ida_image*
+map_image(unsigned int width, unsigned int height, unsigned int stride, void *data)
+{
+    struct ida_image *img;
+
+    img = malloc(sizeof(*img));
+    if (NULL == img)
+    return NULL;
+    memset(img,0,sizeof(*img));
+    img->i.width  = width;
+    img->i.height = height;
+    img->p = pixman_image_create_bits(PIXMAN_r8g8b8, width, height, data, stride);
+    if (NULL == img->p) {
+    free(img);
+    return NULL;
+    }
+    __sync_add_and_fetch(&img_mem, img->i.width * img->i.height * 3);
+    return img;
+}
+
+struct ida_image*
+scale_image_to(struct ida_image *src, unsigned int width, unsigned int height,
+               int cover)
+{
+    pixman_transform_t transform;
+    pixman_fixed_t *params;
+    struct ida_image *dest;
+    double xs, ys, scale;
+    unsigned int sw, sh;
+    int n;
+
+    if (0 == width || 0 == height || 0 == src->i.width || 0 == src->i.height)
+	return src;
+
+    /* fit: whole image visible, cover: whole display used */
+    xs = (double)width  / src->i.width;
+    ys = (double)height / src->i.height;
+    if (cover)
+	scale = (xs > ys) ? xs : ys;
+    else
+	scale = (xs < ys) ? xs : ys;
+    sw = src->i.width  * scale + 0.5;
+    sh = src->i.height * scale + 0.5;
+    if (0 == sw)
+	sw = 1;
+    if (0 == sh)
+	sh = 1;
+    if (sw == src->i.width && sh == src->i.height)
+	return src;
+
+    dest = malloc(sizeof(*dest));
+    if (NULL == dest)
+	return NULL;
+    memset(dest,0,sizeof(*dest));
+    dest->i.width  = (sw < width)  ? sw : width;
+    dest->i.height = (sh < height) ? sh : height;
+    dest->i.dpi    = src->i.dpi;
+    dest->i.npages = 1;
+    ida_image_alloc(dest);
+    if (NULL == dest->p) {
+	free(dest);
+	return NULL;
+    }
+    __sync_add_and_fetch(&img_mem, dest->i.width * dest->i.height * 3);
+
+    /* box filter when shrinking, bilinear when enlarging */
+    pixman_transform_init_scale(&transform,
+				pixman_double_to_fixed((double)src->i.width  / sw),
+				pixman_double_to_fixed((double)src->i.height / sh));
+    pixman_image_set_transform(src->p, &transform);
+    pixman_image_set_repeat(src->p, PIXMAN_REPEAT_PAD);
+    params = NULL;
+    if (sw < src->i.width || sh < src->i.height)
+	params = pixman_filter_create_separable_convolution
+	    (&n, transform.matrix[0][0], transform.matrix[1][1],
+	     PIXMAN_KERNEL_BOX, PIXMAN_KERNEL_BOX,
+	     PIXMAN_KERNEL_BOX, PIXMAN_KERNEL_BOX, 4, 4);
+    if (params) {
+	pixman_image_set_filter(src->p, PIXMAN_FILTER_SEPARABLE_CONVOLUTION,
+				params, n);
+	free(params);
+    } else {
+	pixman_image_set_filter(src->p, PIXMAN_FILTER_BILINEAR, NULL, 0);
+    }
+
+    /* cropped (cover) to the center */
+    pixman_image_composite32(PIXMAN_OP_SRC, src->p, NULL, dest->p,
+			     (sw - dest->i.width) / 2, (sh - dest->i.height) / 2,
+			     0, 0, 0, 0, dest->i.width, dest->i.height);
+
+    pixman_image_set_transform(src->p, NULL);
+    pixman_image_set_filter(src->p, PIXMAN_FILTER_FAST, NULL, 0);
+    pixman_image_set_repeat(src->p, PIXMAN_REPEAT_NONE);
+    return dest;
+}
+
 //static struct ida_image*
 //scale_image(struct ida_image *src, float scale)
 //{
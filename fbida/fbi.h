@@ -5,6 +5,15 @@
 void free_image(struct ida_image *img);
 
 struct ida_image* read_image(char *filename);
+/* like read_image(), but without console switch handling (worker threads) */
+struct ida_image* read_image_bg(char *filename);
+/* image using existing RGB data, data must be valid until free_image() */
+struct ida_image* map_image(unsigned int width, unsigned int height,
+                            unsigned int stride, void *data);
+/* scaled copy which fits into (cover == 0) or covers and is cropped to
+ * width x height, src itself if no scaling is needed, NULL on error */
+struct ida_image* scale_image_to(struct ida_image *src, unsigned int width,
+                                 unsigned int height, int cover);
 
 void shadow_draw_image(gfxstate *gfx, struct ida_image *img, int xoff, int yoff,
           unsigned int first, unsigned int last, int weight);
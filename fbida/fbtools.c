@@ -32,6 +32,9 @@ static struct fb_fix_screeninfo  fb_fix;
 static struct fb_var_screeninfo  fb_var;
 static unsigned char             *fb_mem;
 static int			 fb_mem_offset = 0;
+static int                       fb_page;       /* visible page, double buffering */
+static int                       fb_vsync = 1;  /* FBIO_WAITFORVSYNC works */
+static gfxstate                  *fb_gfx;
 
 static int                       fb;
 
@@ -201,6 +204,50 @@ static void fb_restore_display(void)
     fb_set_palette();
 }
 
+/* show the page drawn last (gfx->mem), then draw into the other one */
+static void fb_flush_display(bool second)
+{
+    uint8_t *back;
+    __u32 crtc = 0;
+
+    fb_page ^= 1;
+    fb_var.yoffset = fb_page * fb_var.yres;
+    if (-1 == ioctl(fb,FBIOPAN_DISPLAY,&fb_var)) {
+	perror("ioctl FBIOPAN_DISPLAY");
+	fb_page ^= 1;
+	fb_var.yoffset = fb_page * fb_var.yres;
+	return;
+    }
+    /* the old page is scanned out until the pan takes effect */
+    if (fb_vsync && -1 == ioctl(fb,FBIO_WAITFORVSYNC,&crtc))
+	fb_vsync = 0;
+
+    back         = fb_gfx->mem;
+    fb_gfx->mem  = fb_gfx->mem2;
+    fb_gfx->mem2 = back;
+}
+
+static void fb_setup_pages(void)
+{
+    struct fb_var_screeninfo var = fb_var;
+
+    if (fb_var.yres_virtual >= 2 * fb_var.yres)
+	return;
+    if (fb_fix.smem_len < 2 * fb_fix.line_length * fb_var.yres)
+	return;
+    /* try to get room for a second page */
+    var.yres_virtual = 2 * var.yres;
+    var.xoffset = 0;
+    var.yoffset = 0;
+    if (-1 == ioctl(fb,FBIOPUT_VSCREENINFO,&var))
+	return;
+    if (-1 == ioctl(fb,FBIOGET_VSCREENINFO,&fb_var) ||
+	-1 == ioctl(fb,FBIOGET_FSCREENINFO,&fb_fix)) {
+	perror("ioctl FBIOGET_*SCREENINFO");
+	exit(-1);
+    }
+}
+
 static void fb_cleanup_display(void)
 {
     /* restore console */
@@ -271,6 +318,7 @@ gfxstate* fb_init(char *device, char *mode, int vt)
 	fprintf(stderr,"can handle only packed pixel frame buffers\n");
 	goto err;
     }
+    fb_setup_pages();
     page_mask = getpagesize()-1;
     fb_mem_offset = (unsigned long)(fb_fix.smem_start) & page_mask;
     fb_mem = mmap(NULL,fb_fix.smem_len+fb_mem_offset,
@@ -292,6 +340,9 @@ gfxstate* fb_init(char *device, char *mode, int vt)
 
     /* cls */
     fb_memset(fb_mem+fb_mem_offset, 0, fb_fix.line_length * fb_var.yres);
+    if (fb_var.yres_virtual >= 2 * fb_var.yres)
+	fb_memset(fb_mem+fb_mem_offset + fb_fix.line_length * fb_var.yres, 0,
+		  fb_fix.line_length * fb_var.yres);
 
     /* init palette */
     switch (fb_var.bits_per_pixel) {
@@ -334,6 +385,16 @@ gfxstate* fb_init(char *device, char *mode, int vt)
 
     gfx->restore_display = fb_restore_display;
     gfx->cleanup_display = fb_cleanup_display;
+
+    /* double buffering: draw into the hidden page, pan on flush */
+    if (fb_var.yres_virtual >= 2 * fb_var.yres &&
+	fb_fix.smem_len >= 2 * fb_fix.line_length * fb_var.yres) {
+	fb_page = 0;
+	gfx->mem           = fb_mem + fb_mem_offset + fb_fix.line_length * fb_var.yres;
+	gfx->mem2          = fb_mem + fb_mem_offset;
+	gfx->flush_display = fb_flush_display;
+	fb_gfx = gfx;
+    }
     return gfx;
 
  err:
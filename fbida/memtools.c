@@ -0,0 +1,151 @@
+/*
+ * headless backend: framebuffer in memory, for benchmarks and tests
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memtools.h"
+
+/* -------------------------------------------------------------------- */
+
+static gfxstate *mem_gfx;
+static char     *mem_dump;
+
+static void mem_restore_display(void)
+{
+    /* nothing to restore */
+}
+
+static void mem_cleanup_display(void)
+{
+    if (!mem_gfx)
+	return;
+    if (mem_dump) {
+	if (0 != mem_dump_ppm(mem_gfx, mem_dump))
+	    fprintf(stderr, "can't write %s\n", mem_dump);
+	free(mem_dump);
+	mem_dump = NULL;
+    }
+    free(mem_gfx->mem);
+    mem_gfx->mem = NULL;
+    mem_gfx = NULL;
+}
+
+/* scale a channel of len bits to 8 bits */
+static uint8_t mem_channel(uint32_t pixel, uint32_t len, uint32_t off)
+{
+    uint32_t v;
+
+    if (len == 0)
+	return 0;
+    v = (pixel >> off) & ((1u << len) - 1);
+    if (len >= 8)
+	return v >> (len - 8);
+    /* replicate the high bits, 0x1f -> 0xff */
+    v <<= 8 - len;
+    return v | (v >> len);
+}
+
+int mem_dump_ppm(gfxstate *gfx, const char *filename)
+{
+    unsigned int bytes = (gfx->bits_per_pixel + 7) / 8;
+    uint8_t *line, *src;
+    uint32_t pixel;
+    unsigned int x, y, b;
+    FILE *fp;
+    int rc = 0;
+
+    fp = fopen(filename, "wb");
+    if (NULL == fp)
+	return -1;
+    line = malloc(gfx->hdisplay * 3);
+    if (NULL == line) {
+	fclose(fp);
+	return -1;
+    }
+
+    fprintf(fp, "P6\n%u %u\n255\n", gfx->hdisplay, gfx->vdisplay);
+    for (y = 0; y < gfx->vdisplay; y++) {
+	src = gfx->mem + y * gfx->stride;
+	for (x = 0; x < gfx->hdisplay; x++, src += bytes) {
+	    for (pixel = 0, b = 0; b < bytes; b++)
+		pixel |= (uint32_t)src[b] << (8 * b);
+	    line[3*x+0] = mem_channel(pixel, gfx->rlen, gfx->roff);
+	    line[3*x+1] = mem_channel(pixel, gfx->glen, gfx->goff);
+	    line[3*x+2] = mem_channel(pixel, gfx->blen, gfx->boff);
+	}
+	if (1 != fwrite(line, gfx->hdisplay * 3, 1, fp))
+	    rc = -1;
+    }
+    free(line);
+    if (0 != fclose(fp))
+	rc = -1;
+    return rc;
+}
+
+int mem_parse_mode(const char *mode, uint32_t *width, uint32_t *height, uint32_t *bpp)
+{
+    unsigned int w, h, b = 32;
+    char end;
+    int n;
+
+    n = sscanf(mode, "%ux%ux%u%c", &w, &h, &b, &end);
+    if (n != 2 && n != 3)
+	return -1;
+    if (w == 0 || h == 0 || w > 16384 || h > 16384)
+	return -1;
+    if (b != 16 && b != 24 && b != 32)
+	return -1;
+    *width  = w;
+    *height = h;
+    *bpp    = b;
+    return 0;
+}
+
+/* -------------------------------------------------------------------- */
+
+gfxstate *mem_init(uint32_t width, uint32_t height, uint32_t bpp, const char *dump)
+{
+    gfxstate *gfx;
+
+    if (bpp != 16 && bpp != 24 && bpp != 32) {
+	fprintf(stderr, "headless: %u bit/pixel not supported\n", bpp);
+	return NULL;
+    }
+    fprintf(stderr, "using headless: %ux%u, %u bpp\n", width, height, bpp);
+
+    gfx = malloc(sizeof(*gfx));
+    if (NULL == gfx)
+	return NULL;
+    memset(gfx, 0, sizeof(*gfx));
+
+    gfx->hdisplay        = width;
+    gfx->vdisplay        = height;
+    gfx->stride          = (width * ((bpp + 7) / 8) + 63) & ~63;
+    gfx->mem             = calloc(height, gfx->stride);
+    if (NULL == gfx->mem) {
+	free(gfx);
+	return NULL;
+    }
+
+    if (bpp == 16) {
+	gfx->rlen = 5; gfx->roff = 11;
+	gfx->glen = 6; gfx->goff = 5;
+	gfx->blen = 5; gfx->boff = 0;
+    } else {
+	gfx->rlen = 8; gfx->roff = 16;
+	gfx->glen = 8; gfx->goff = 8;
+	gfx->blen = 8; gfx->boff = 0;
+    }
+    gfx->bits_per_pixel  = bpp;
+
+    gfx->restore_display = mem_restore_display;
+    gfx->cleanup_display = mem_cleanup_display;
+
+    mem_gfx  = gfx;
+    mem_dump = dump ? strdup(dump) : NULL;
+    return gfx;
+}
@@ -0,0 +1,12 @@
+#include "gfx.h"
+
+/* headless backend, framebuffer in memory
+ * bpp: 16 (RGB565), 24 (BGR888 in memory) or 32 (XRGB8888)
+ * dump: write the final framebuffer as PPM on cleanup or NULL */
+gfxstate *mem_init(uint32_t width, uint32_t height, uint32_t bpp, const char *dump);
+
+/* parse "WIDTHxHEIGHT[xBPP]", bpp defaults to 32 */
+int mem_parse_mode(const char *mode, uint32_t *width, uint32_t *height, uint32_t *bpp);
+
+/* write the framebuffer as binary PPM */
+int mem_dump_ppm(gfxstate *gfx, const char *filename);
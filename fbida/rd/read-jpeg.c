@@ -149,9 +149,21 @@ jpeg_init(FILE *fp, char *filename, unsigned int page,
     }
 
     h->cinfo.out_color_space = JCS_RGB;
+    if (!h->thumbnail && load_cover_width && load_cover_height) {
+	/* DCT scaling: decode at the smallest 1/2^n size still covering
+	 * the display, libjpeg rounds the output size up */
+	h->cinfo.scale_num   = 1;
+	h->cinfo.scale_denom = 1;
+	while (h->cinfo.scale_denom < 8 &&
+	       h->cinfo.image_width  / (h->cinfo.scale_denom * 2) >= load_cover_width &&
+	       h->cinfo.image_height / (h->cinfo.scale_denom * 2) >= load_cover_height)
+	    h->cinfo.scale_denom *= 2;
+	if (debug && h->cinfo.scale_denom > 1)
+	    fprintf(stderr,"jpeg: decode at 1/%u\n", h->cinfo.scale_denom);
+    }
     jpeg_start_decompress(&h->cinfo);
-    i->width  = h->cinfo.image_width;
-    i->height = h->cinfo.image_height;
+    i->width  = h->cinfo.output_width;
+    i->height = h->cinfo.output_height;
     i->npages = 1;
     switch (h->cinfo.density_unit) {
     case 0: /* unknown */
@@ -166,6 +166,13 @@ void ida_image_free(struct ida_image *img)
 
 /* ----------------------------------------------------------------------- */
 
+/* display size, loaders able to scale while decoding (jpeg) only need to
+ * cover this, 0 means full size always */
+unsigned int load_cover_width;
+unsigned int load_cover_height;
+
+/* ----------------------------------------------------------------------- */
+
 LIST_HEAD(loaders);
 
 void load_register(struct ida_loader *loader)
@@ -98,6 +98,8 @@ void ida_image_free(struct ida_image *img);
 
 /* other */
 extern int debug;
+extern unsigned int load_cover_width;
+extern unsigned int load_cover_height;
 extern struct ida_loader ppm_loader;
 extern struct ida_loader jpeg_loader;
 extern struct ida_loader sane_loader;
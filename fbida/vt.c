@@ -121,11 +121,17 @@ void console_switch_cleanup(void)
 
 int check_console_switch(void)
 {
-    if (!console_switching_active)
+    /* the redraw may wait for images and check again */
+    static bool busy;
+    bool redraw = false;
+
+    if (!console_switching_active || busy)
         return 0;
     if (switch_last == console_switch_state)
         return 0;
 
+    busy = true;
+
     switch (console_switch_state) {
     case CONSOLE_REL_REQ:
 	console_switch_release();
@@ -136,12 +142,16 @@ int check_console_switch(void)
 	console_switch_acquire();
     case CONSOLE_ACTIVE:
 	console_visible = 1;
-        console_redraw();
+	redraw = true;
 	break;
     default:
 	break;
     }
+    /* a switch signaled while redrawing is handled by the next check */
     switch_last = console_switch_state;
+    if (redraw)
+        console_redraw();
+    busy = false;
     return 1;
 }
 
@@ -12,12 +12,22 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <getopt.h>
 
 #include "debug.h"
 #include "input.h"
+#include "input_evdev.h"
 #include "menu.h"
+#include "cache.h"
+#include "bundle.h"
+#include "transition.h"
+#include "trace.h"
 #include "fbida/fbi.h"
 #include "fbida/fbtools.h"
+#include "fbida/memtools.h"
+#ifdef HAVE_DRM
+#include "fbida/drmtools.h"
+#endif
 #include "fbida/fb-gui.h"
 #include "fbida/vt.h"
 #include "fbida/kbd.h"
@@ -31,6 +41,21 @@ menu_scroll_mode scrollMode = menu_scroll_mode_1;
 char *fileName = NULL;
 uint8_t xMax = 1, yMax = 1;
 int defaultSelection = -1;
+int lazyLoad = 0;
+char *cacheDir = NULL;
+char *packFileName = NULL;
+transition_mode transitionMode = transition_none;
+int transitionTime = 250;   // ms
+int perfLog = 0;
+char *traceFileName = NULL;
+char *headlessMode = NULL;
+char *dumpFileName = NULL;
+menu_scale_mode scaleMode = menu_scale_none;
+size_t cacheBudget = 0;     // bytes, 0 = keep all tiles
+
+static menu *m;
+static int drawnIdx = -1;   // menu index currently on screen
+static input_event lastEvent = input_none;
 
 
 static jmp_buf fb_fatal_cleanup;
@@ -75,6 +100,8 @@ static void exit_signals_init(void)
 
 static void cleanup_and_exit(int code)
 {
+    trace_stop();
+    cache_stop();
     shadow_fini();
     tty_restore();
     gfx->cleanup_display();
@@ -84,19 +111,135 @@ static void cleanup_and_exit(int code)
 }
 
 
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+
+static void show_transition(int fromIdx, int toIdx)
+{
+    transition_tile from, to;
+    transition_perf perf;
+    int dx = 0, dy = 0;
+    int retval;
+
+    // native images if available, else RGB
+    from.native = menu_native_at(m, fromIdx);
+    from.img    = (from.native != NULL) ? NULL : menu_img_at(m, fromIdx);
+    to.native   = menu_native_at(m, toIdx);
+    to.img      = (to.native != NULL) ? NULL : menu_img_at(m, toIdx);
+
+    // slide in the scroll direction, also if the marker rolled over
+    switch (lastEvent)
+    {
+    case input_left:  dx = -1; break;
+    case input_right: dx =  1; break;
+    case input_up:    dy = -1; break;
+    case input_down:  dy =  1; break;
+    default:
+        dx = sign(toIdx % m->xMax - fromIdx % m->xMax);
+        if (dx == 0) { dy = sign(toIdx / m->xMax - fromIdx / m->xMax); }
+        break;
+    }
+
+    retval = transition_run(gfx, transitionMode, transitionTime, &from, &to,
+                            dx, dy, input_pending, &perf);
+    if (perfLog && (retval >= 0) && (perf.frames > 0))
+    {
+        debugOut(debug_level0, "transition %d -> %d: %d frames in %ld ms, "
+                 "render avg %ld us, max %ld us, %ld fps%s\n",
+                 fromIdx + 1, toIdx + 1, perf.frames, perf.totalUs / 1000,
+                 perf.renderUs / perf.frames, perf.maxRenderUs,
+                 perf.frames * 1000000L / (perf.totalUs ? perf.totalUs : 1),
+                 retval ? " (canceled)" : "");
+    }
+}
+
+
+static void draw_menu(void)
+{
+    struct gfx_image *gimg;
+    struct ida_image *img;
+
+    if ((transitionMode != transition_none) && (drawnIdx >= 0) && (drawnIdx != menu_get(m)))
+    {
+        show_transition(drawnIdx, menu_get(m));
+    }
+
+    gimg = menu_native(m);
+    if (gimg != NULL)
+    {
+        shadow_draw_native(gfx, gimg);
+        drawnIdx = menu_get(m);
+        return;
+    }
+
+    img = menu_img(m);
+    if (img != NULL)
+    {
+        shadow_draw_image(gfx, img, 0, 0, 0, gfx->vdisplay-1, 100);
+        shadow_render(gfx);
+        drawnIdx = menu_get(m);
+    }
+}
+
+
 static void console_switch_redraw(void)
 {
     gfx->restore_display();
+    // the other console drew everywhere, not only into our used spans
     shadow_set_dirty();
-    shadow_render(gfx);
+    draw_menu();
+}
+
+
+static int parseLayout(int argc, char **argv)
+{
+    if ((argc - optind) == 2)
+    {
+        if (    (argv[optind][0] >= '1') && (argv[optind][0] <= '9') &&
+                (argv[optind][1] == 'x') &&
+                (argv[optind][2] >= '1') && (argv[optind][2] <= '9') &&
+                (argv[optind][3] == 0))
+        {
+            xMax = argv[optind][0] - '0';
+            yMax = argv[optind][2] - '0';
+        }
+        else
+        {
+            return -1;
+        }
+
+        fileName = argv[optind+1];
+
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
 }
 
 
 int parseArgs(int argc, char **argv)
 {
+    static const struct option longOpts[] =
+    {
+        { "transition", required_argument, NULL, 't' },
+        { "perf",       no_argument,       NULL, 'p' },
+        { "trace",      required_argument, NULL, 'T' },
+        { "headless",   required_argument, NULL, 'H' },
+        { "dump",       required_argument, NULL, 'D' },
+        { "fit",        no_argument,       NULL, 'F' },
+        { "fill",       no_argument,       NULL, 'L' },
+        { "cache-mb",   required_argument, NULL, 'M' },
+        { "evdev",      optional_argument, NULL, 'E' },
+        { NULL,         0,                 NULL, 0 }
+    };
     int opt;
 
-    while ((opt = getopt(argc, argv, "hs:d:")) != -1)
+    while ((opt = getopt_long(argc, argv, "hlc:s:d:t:", longOpts, NULL)) != -1)
     {
         switch (opt)
         {
@@ -136,6 +279,80 @@ int parseArgs(int argc, char **argv)
                 return -1;
             }
             break;
+        case 'l':
+            lazyLoad = 1;
+            break;
+        case 'c':
+            cacheDir = optarg;
+            break;
+        case 't':
+            if (optarg != NULL)
+            {
+                // mode[,ms]
+                char *sep = strchr(optarg, ',');
+                if (sep != NULL)
+                {
+                    char * next;
+                    long val = strtol(sep + 1, &next, 10);
+                    if ((next == sep + 1) || (*next != 0) || (val <= 0) || (val > 10000))
+                    {
+                        return -1;
+                    }
+                    transitionTime = val;
+                    *sep = 0;
+                }
+                if (0 != transition_parse(optarg, &transitionMode))
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+                return -1;
+            }
+            break;
+        case 'p':
+            perfLog = 1;
+            break;
+        case 'T':
+            traceFileName = optarg;
+            break;
+        case 'H':
+            headlessMode = optarg;
+            break;
+        case 'D':
+            dumpFileName = optarg;
+            break;
+        case 'F':
+            scaleMode = menu_scale_fit;
+            break;
+        case 'L':
+            scaleMode = menu_scale_fill;
+            break;
+        case 'M':
+            {
+                char * next;
+                long val = strtol(optarg, &next, 10);
+                if ((optarg == next) || (*next != 0) || (val <= 0) || (val > 65536))
+                {
+                    return -1;
+                }
+                cacheBudget = (size_t)val << 20;
+            }
+            break;
+        case 'E':
+            if (optarg != NULL)
+            {
+                if (0 != evdev_cfgAddDev(optarg))
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+                evdev_cfgScan();
+            }
+            break;
         case 'h':
         case '?':
         default:
@@ -143,29 +360,50 @@ int parseArgs(int argc, char **argv)
         }
     }
 
-    if ((argc - optind) == 2)
+    return parseLayout(argc, argv);
+}
+
+
+int parsePackArgs(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ho:")) != -1)
     {
-        if (    (argv[optind][0] >= '1') && (argv[optind][0] <= '9') &&
-                (argv[optind][1] == 'x') &&
-                (argv[optind][2] >= '1') && (argv[optind][2] <= '9') &&
-                (argv[optind][3] == 0))
-        {
-            xMax = argv[optind][0] - '0';
-            yMax = argv[optind][2] - '0';
-        }
-        else
+        switch (opt)
         {
+        case 'o':
+            packFileName = optarg;
+            break;
+        case 'h':
+        case '?':
+        default:
             return -1;
         }
-
-        fileName = argv[optind+1];
-
-        return 0;
     }
-    else
+
+    if (packFileName == NULL)
     {
         return -1;
     }
+
+    return parseLayout(argc, argv);
+}
+
+
+static int pack(void)
+{
+    menu *pm;
+    int retval;
+
+    pm = menu_creat(xMax, yMax, fileName);
+    if (pm == NULL) { return -1; }
+
+    retval = bundle_write(packFileName, pm->xMax, pm->yMax, pm->imgArr);
+
+    menu_destroy(pm);
+
+    return retval;
 }
 
 
@@ -173,23 +411,57 @@ int main(int argc, char **argv)
 {
     int vt = 0;
     char *videoMode = NULL;
-    menu * m;
+    menu_cfg cfg;
     int select = -1;
-    input_event event;
+    input_event events[16];
+    int cnt, i;
 
     setDebugLevel(debug_level0);
 
+    if ((argc > 1) && (strcmp(argv[1], "--pack") == 0))
+    {
+        if (0 != parsePackArgs(argc - 1, argv + 1))
+        {
+            return -1;
+        }
+        return pack();
+    }
+
     if (0 != parseArgs(argc, argv))
     {
         return -1;
     }
 
-    m = menu_creat(xMax, yMax, fileName);
-    if (m == NULL) { return -1; }
-    menu_set(m, defaultSelection);
-
-    input_init();
-    gfx = fb_init(NULL, videoMode, vt);
+    if (0 != input_init())
+    {
+        debugOut(debug_level0, "NOTICE: Input not completely available.\n");
+    }
+    if (headlessMode != NULL)
+    {
+        // no display, e.g. for benchmarks
+        uint32_t width, height, bpp;
+        if (0 != mem_parse_mode(headlessMode, &width, &height, &bpp))
+        {
+            debugOut(debug_level0, "Invalid headless mode %s\n", headlessMode);
+            input_stop();
+            return -1;
+        }
+        gfx = mem_init(width, height, bpp, dumpFileName);
+        if (gfx == NULL)
+        {
+            input_stop();
+            return -1;
+        }
+    }
+#ifdef HAVE_DRM
+    /* try drm first (unless fbdev is requested), failing that fb */
+    if ((gfx == NULL) && (getenv("FRAMEBUFFER") == NULL)) {
+        gfx = drm_init(NULL, NULL, videoMode, vt);
+    }
+#endif
+    if (gfx == NULL) {
+        gfx = fb_init(NULL, videoMode, vt);
+    }
 
     exit_signals_init();
     signal(SIGTSTP,SIG_IGN);
@@ -199,15 +471,53 @@ int main(int argc, char **argv)
     }
     shadow_init(gfx);
 
+    // no need to decode more than the display shows
+    load_cover_width  = gfx->hdisplay;
+    load_cover_height = gfx->vdisplay;
+
+    if ((cacheDir != NULL) && (cache_init(cacheDir, gfx, scaleMode) != 0)) {
+        debugOut(debug_level0, "NOTICE: No image cache available.\n");
+    }
+
+    if (trace_init(traceFileName) < 0) {
+        debugOut(debug_level0, "NOTICE: No latency trace available.\n");
+    }
+
     tty_raw();
 
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.select = defaultSelection;
+    cfg.lazy = lazyLoad;
+    cfg.gfx = gfx;
+    cfg.scale = scaleMode;
+    cfg.budget = cacheBudget;
+    m = menu_creat_cfg(xMax, yMax, fileName, &cfg);
+    if (m == NULL) { cleanup_and_exit(-1); }
+
     while (select < 0)
     {
-        shadow_draw_image(gfx, menu_img(m), 0, 0, 0, gfx->vdisplay-1, 100);
-        shadow_render(gfx);
+        // most wakeups (timeouts, unmapped keys, ...) do not move the marker
+        if (menu_get(m) != drawnIdx)
+        {
+            draw_menu();
+        }
 
-        event = input_get();
-        select = menu_task(m, scrollMode, event);
+        // apply all events of one wakeup, then draw once
+        cnt = input_get_batch(events, sizeof(events) / sizeof(events[0]));
+        if (cnt < 0)
+        {
+            // would return at once again and again
+            debugOut(debug_level0, "No input available, exit\n");
+            break;
+        }
+        // a vt switch signal interrupts the wait, the switch is done here
+        check_console_switch();
+        for (i = 0; (i < cnt) && (select < 0); ++i)
+        {
+            lastEvent = events[i];
+            select = menu_task(m, scrollMode, events[i]);
+        }
+        trace_mark(trace_menu);
     }
 
     menu_destroy(m);
@@ -9,105 +9,403 @@
 #include "input.h"
 #include "input_kbd.h"
 #include "input_joy.h"
+#include "input_evdev.h"
 #include "timer.h"
+#include "trace.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
 #include <fcntl.h>
-#include <poll.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+
+#define INPUT_TIMER_ID  0xFFFFFFFFu     // epoll data of the timerfd
+#define INPUT_EVENTS    16              // max. ready fds handled per wakeup
+#define INPUT_PENDING   32              // size of pending event queue, power of 2
+
+static int epollFd = -1;
+static int timerFd = -1;
+static int timerArmed = 0;
+static struct timespec timerDeadline;
+
+// events decoded by input_pending(), returned first by input_get_batch()
+static input_event pendingQueue[INPUT_PENDING];
+static unsigned pendingHead = 0;    // next write
+static unsigned pendingTail = 0;    // next read
+
+#define INPUT_MAP_TABLES 8              // max. maps with a lookup table
+
+// dense key code -> event tables, one per event map
+static struct
+{
+    const void  *map;
+    uint8_t     event[KEY_CNT];
+} mapTables[INPUT_MAP_TABLES];
+static int mapTableCnt = 0;
 
 
 int input_init(void)
 {
+    struct epoll_event ev;
     int err = 0;
+
+    if (epollFd >= 0) { return -1; }
+
+    // all driver fds and the timer live in one epoll set for the whole run
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = INPUT_TIMER_ID;
+    if (   (epollFd < 0) || (timerFd < 0)
+        || (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev) != 0))
+    {
+        // no half initialized state, input_get_batch() then reports -1
+        debugOut(debug_level0, "Err epoll/timerfd: %d\n", errno);
+        input_stop();
+        return -1;
+    }
+    timerArmed = 0;
+    pendingHead = pendingTail = 0;
+
     err = kbd_init();
     err |= joy_init();
+    err |= evdev_init();
     return err;
 }
 
 
 void input_stop(void)
 {
+    evdev_stop();
     joy_stop();
     kbd_stop();
+
+    if (timerFd >= 0)
+    {
+        close(timerFd);
+        timerFd = -1;
+    }
+    if (epollFd >= 0)
+    {
+        close(epollFd);
+        epollFd = -1;
+    }
 }
 
 
-static int lastFdNr = -1;
+int input_watch(int fd, input_driver drv, int devNr)
+{
+    struct epoll_event ev;
+
+    if ((epollFd < 0) || (fd < 0)) { return -1; }
 
-input_event input_get(void)
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = ((uint32_t)drv << 16) | (uint16_t)devNr;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0) { return 0; }
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0 ? 0 : -1;
+}
+
+
+void input_unwatch(int fd)
 {
-    input_event event = input_none;
-    struct pollfd fds[INPUT_JOY_MAXFD + INPUT_KBD_MAX];
-    const int nfds = sizeof(fds) / sizeof(fds[0]);
-    int timeout = -1; // ms
-    int retval;
-    int i;
+    if ((epollFd >= 0) && (fd >= 0))
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+}
+
 
-    memset(fds, 0, sizeof(fds));
+/**
+ * @brief Arm the timerfd for the next driver task deadline.
+ *
+ * The timer is only touched if the deadline changed, so most waits cost
+ * no extra syscall.
+ * @param timeout   ms from now, <0 for no deadline
+ */
+static void input_armTimer(int timeout)
+{
+    struct itimerspec its;
+    struct timespec deadline;
+    long diffMs;
 
-    for (i = 0; i < INPUT_JOY_MAXFD; ++i)
+    memset(&its, 0, sizeof(its));
+    if (timeout < 0)
     {
-        fds[i].fd = joy_getFd(i);
-        fds[i].events = POLLIN;
+        if (timerArmed)
+        {
+            timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+            timerArmed = 0;
+        }
+        return;
     }
 
-    for (i = 0; i < INPUT_KBD_MAX; ++i)
+    // getTimeout() truncates, 1 ms more to be past the deadline for sure
+    ++timeout;
+    getCurClock(&deadline);
+    deadline.tv_sec  += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
     {
-        fds[INPUT_JOY_MAXFD+i].fd = kbd_getFd(i);
-        fds[INPUT_JOY_MAXFD+i].events = POLLIN;
+        deadline.tv_nsec -= 1000000000L;
+        ++deadline.tv_sec;
     }
 
+    if (timerArmed)
+    {
+        diffMs = (deadline.tv_sec - timerDeadline.tv_sec) * 1000L +
+                 (deadline.tv_nsec - timerDeadline.tv_nsec) / 1000000L;
+        if ((diffMs >= -1) && (diffMs <= 1)) { return; }
+    }
+
+    its.it_value = deadline;
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+    timerDeadline = deadline;
+    timerArmed = 1;
+}
+
+
+/**
+ * @brief Consume an expired timer, the deadline is checked again by
+ *        the driver tasks on the next wait.
+ */
+static void input_ackTimer(void)
+{
+    uint64_t expirations;
+
+    read(timerFd, &expirations, sizeof(expirations));
+    timerArmed = 0;
+}
+
+
+/**
+ * @brief Let the driver read all data from a ready fd.
+ * @param id    epoll data given to input_watch()
+ * @param out   Array for the events.
+ * @param max   Size of out, >0.
+ * @return      Number of events read.
+ */
+static int input_read(uint32_t id, input_event *out, int max)
+{
+    int devNr = id & 0xFFFF;
+
+    switch ((input_driver)(id >> 16))
+    {
+    case input_driver_joy:
+        return joy_getEvents(devNr, out, max);
+    case input_driver_kbd:
+        return kbd_getEvents(devNr, out, max);
+    case input_driver_evdev:
+        return evdev_getEvents(devNr, out, max);
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * @brief Drop all events after the first one ending the menu.
+ * @param events
+ * @param cnt   Number of events.
+ * @return      New number of events.
+ */
+static int input_coalesce(const input_event *events, int cnt)
+{
+    int i;
+
+    for (i = 0; i < cnt; ++i)
+    {
+        if ((events[i] < input_left) || (events[i] > input_down)) { return i + 1; }
+    }
+    return cnt;
+}
+
+
+int input_get_batch(input_event *out, int max)
+{
+    struct epoll_event evs[INPUT_EVENTS];
+    int timeout = -1; // ms
+    int cnt = 0;
+    int retval;
+    int i;
+
+    if ((out == NULL) || (max <= 0)) { return 0; }
+    if (epollFd < 0) { return -1; }
+
     timeout = getMinTimeout(timeout, kbd_getTaskTimeout());
     timeout = getMinTimeout(timeout, joy_getTaskTimeout());
+    timeout = getMinTimeout(timeout, evdev_getTaskTimeout());
+    input_armTimer(timeout);
 
-    retval = poll(fds, nfds, timeout);
+    // events decoded before (or by a driver task) are returned without blocking
+    while ((cnt < max) && (pendingTail != pendingHead))
+    {
+        out[cnt++] = pendingQueue[pendingTail++ & (INPUT_PENDING - 1)];
+    }
+    cnt += kbd_getQueued(out + cnt, max - cnt);
+    if (cnt >= max)
+    {
+        retval = 0;
+    }
+    else
+    {
+        retval = epoll_wait(epollFd, evs, INPUT_EVENTS, (cnt > 0) ? 0 : -1);
+    }
 
     if (-1 == retval)       // error
     {
+        if (errno == EINTR) { return input_coalesce(out, cnt); }
         debugOut(debug_level0, "Error\n");
-        return input_abort;
+        out[0] = input_abort;
+        return 1;
     }
-    else if (retval)        // have data
+
+    // every ready fd, fds not read because out is full stay ready
+    for (i = 0; (i < retval) && (cnt < max); ++i)
     {
-        ++lastFdNr;
-        for (i = 0; i < nfds; ++i)
+        if (evs[i].data.u32 == INPUT_TIMER_ID)
         {
-            int fdNr = lastFdNr + i;
-            if (fdNr >= nfds) { fdNr -= nfds; }
-            if (fds[fdNr].revents)
-            {
-                if (fdNr < INPUT_JOY_MAXFD)
-                {
-                    event = joy_getEvent(fdNr);
-                }
-                else
-                {
-                    event = kbd_getEvent(fdNr - INPUT_JOY_MAXFD);
-                }
-                lastFdNr = fdNr;
-                break; // hande only one event
-            }
+            input_ackTimer();   // deadline reached, driver tasks run on next call
+        }
+        else
+        {
+            cnt += input_read(evs[i].data.u32, out + cnt, max - cnt);
         }
     }
-    else                    // timeout
+
+    cnt = input_coalesce(out, cnt);
+    if (cnt > 0) { trace_mark(trace_input); }
+
+    return cnt;
+}
+
+
+input_event input_get(void)
+{
+    input_event event = input_none;
+
+    input_get_batch(&event, 1);
+
+    return event;
+}
+
+
+/**
+ * @brief Decode the data of all ready fds into the pending queue.
+ * @param timeout   Max. time to wait for data in ms.
+ * @return          Number of events queued.
+ */
+static int input_decodePending(int timeout)
+{
+    struct epoll_event evs[INPUT_EVENTS];
+    input_event events[INPUT_PENDING];
+    int retval, cnt = 0, n, i, k;
+
+    retval = epoll_wait(epollFd, evs, INPUT_EVENTS, timeout);
+
+    for (i = 0; i < retval; ++i)
     {
-        // nothing more to do
+        if (evs[i].data.u32 == INPUT_TIMER_ID)
+        {
+            input_ackTimer();   // only a driver deadline, no input
+            continue;
+        }
+
+        // fds not read because the queue is full stay ready
+        n = INPUT_PENDING - (int)(pendingHead - pendingTail);
+        if (n <= 0) { break; }
+        n = input_read(evs[i].data.u32, events, n);
+        for (k = 0; k < n; ++k)
+        {
+            pendingQueue[pendingHead++ & (INPUT_PENDING - 1)] = events[k];
+        }
+        cnt += n;
     }
 
-    return event;
+    return cnt;
+}
+
+
+int input_pending(int timeout)
+{
+    struct timespec start;
+    int to = timeout;
+
+    if (epollFd < 0) { return 0; }
+
+    getCurClock(&start);
+    for (;;)
+    {
+        if ((pendingTail != pendingHead) || kbd_pending()) { return 1; }
+
+        // releases, SYN reports, axes around the middle, ... are no input
+        if (input_decodePending(to) > 0) { return 1; }
+        if (kbd_pending()) { return 1; }
+        if (timeout == 0) { return 0; }
+        to = getTimeout(&start, timeout);
+        if (to <= 0) { return 0; }
+    }
+}
+
+
+/**
+ * @brief Get the lookup table of a map, build it on first use.
+ * @param map
+ * @return      Table indexed by key code or NULL if all tables are used.
+ */
+static const uint8_t *input_mapTable(const event_map map)
+{
+    uint8_t *table;
+    int i, e, n;
+
+    for (i = 0; i < mapTableCnt; ++i)
+    {
+        if (mapTables[i].map == map) { return mapTables[i].event; }
+    }
+    if (mapTableCnt >= INPUT_MAP_TABLES) { return NULL; }
+
+    // first match wins, like the former scan in event order
+    table = mapTables[mapTableCnt].event;
+    memset(table, input_none, sizeof(mapTables[0].event));
+    for (e = input_event_cnt - 1; e > input_none; --e)
+    {
+        for (n = 0; (map[e] != NULL) && (map[e][n] != 0); ++n)
+        {
+            if ((map[e][n] > 0) && (map[e][n] < KEY_CNT))
+            {
+                table[map[e][n]] = (uint8_t)e;
+            }
+        }
+    }
+    mapTables[mapTableCnt].map = map;
+    return mapTables[mapTableCnt++].event;
+}
+
+
+void key2event_init(const event_map map)
+{
+    input_mapTable(map);
 }
 
 
 input_event key2event(const event_map map, int key)
 {
+    const uint8_t *table = input_mapTable(map);
     input_event event = input_none;
     int e, n;
 
+    if (table != NULL)
+    {
+        return ((key > 0) && (key < KEY_CNT)) ? (input_event)table[key] : input_none;
+    }
+
     for (e = 0; e < input_event_cnt; ++e)
     {
         if (map[e] != NULL)
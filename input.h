@@ -34,6 +34,13 @@ typedef enum
 
 typedef int * event_map[input_event_cnt];
 
+typedef enum
+{
+    input_driver_joy,
+    input_driver_kbd,
+    input_driver_evdev
+} input_driver;
+
 
 /**
  * Init input logic.
@@ -56,17 +63,75 @@ void input_stop(void);
 /**
  * Wait on next input event and return it.
  *
- * Currently this also returns after a timeout (1s)
- * to give you a change to poll something.
+ * This also returns after driver deadlines (e.g. ESC timeout)
+ * or input which does not result in an event.
  *
  * @return Current input event or input_none on timeout.
  */
 input_event input_get(void);
 
+/**
+ * Wait for input and return all events read in one wakeup.
+ *
+ * Like input_get(), but every ready device is read, not only one,
+ * and all data queued is read at once.
+ * Events after the first one not moving the marker (select, abort)
+ * are dropped. Apply all events and redraw once, so repeated moves
+ * result in one net move on screen.
+ *
+ * @param out   Array for the events.
+ * @param max   Size of out.
+ * @return      Number of events in out, 0 on timeout, -1 if not initialized.
+ */
+int input_get_batch(input_event *out, int max);
+
+
+/**
+ * Wait for pending input events.
+ *
+ * Ready devices are read and decoded, data not resulting in an event
+ * (e.g. a key release) is no pending input. The events decoded are
+ * returned by the next input_get_batch().
+ *
+ * @param timeout   Max. time to wait in ms, 0 to only check.
+ * @return          1 if input is pending, 0 on timeout.
+ */
+int input_pending(int timeout);
+
+/**
+ * Watch a driver fd for input, for input drivers only.
+ *
+ * If the fd gets readable, the driver's getEvent(devNr) is called.
+ *
+ * @param fd    File descriptor to watch.
+ * @param drv   Driver owning the fd.
+ * @param devNr Device number passed to the driver.
+ * @return      0 on success, -1 on error or if input_init() was not called.
+ */
+int input_watch(int fd, input_driver drv, int devNr);
+
+/**
+ * Stop watching a driver fd, call it before closing the fd.
+ *
+ * @param fd    File descriptor given to input_watch().
+ */
+void input_unwatch(int fd);
+
+/**
+ * Build the lookup table used by key2event() for a map.
+ *
+ * Call it from driver init, so the first key does not pay for it.
+ * A map must be static and must not change once it was used.
+ *
+ * @param map   Map used for the conversion, last element must be a 0.
+ */
+void key2event_init(const event_map map);
 
 /**
  * Helper function to map a key code to an input event.
  *
+ * Uses a table indexed by key code (up to KEY_MAX), built on first use.
+ *
  * @param map   Map used for the conversion, last element must be a 0.
  * @param key   key code, see linux/input.h
  * @return      Matching event from map or input_none
@@ -0,0 +1,588 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "input_evdev.h"
+#include "input.h"
+#include "timer.h"
+#include "debug.h"
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <linux/input.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+    #include <sys/inotify.h>
+#endif
+
+#define EVDEV_NAME_MAX  255
+#define EVDEV_DIR       "/dev/input"
+
+#define EVDEV_CHUNK     64              // max. struct input_event per read()
+#define EVDEV_ABS_CNT   (ABS_HAT3Y + 1) // axes handled, see abs2Event()
+
+#define BITS_PER_LONG   (8 * sizeof(unsigned long))
+#define NBITS(x)        (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+static int  init = 0;
+static int  scan = 0;
+static int  devCnt = 0;
+static char devNames[INPUT_EVDEV_MAX][EVDEV_NAME_MAX];
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_POLL
+    static int             taskCycle = 2000; // ms
+    static struct timespec lastCycle;
+#elif FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+    static int notify_fd = -1;
+#endif
+
+typedef struct evdev_data
+{
+    int                 fd;
+    char                name[EVDEV_NAME_MAX];   // device path, used by scan
+    int32_t             absMid[EVDEV_ABS_CNT];
+    int32_t             absHalf[EVDEV_ABS_CNT]; // 0 for unknown axes
+    int8_t              absState[EVDEV_ABS_CNT]; // -1, 0, 1
+} evdev_data_t;
+
+static evdev_data_t     devs[INPUT_EVDEV_MAX];
+
+
+static int evdev_select1[]  = {KEY_1, KEY_KP1, 0};
+static int evdev_select2[]  = {KEY_2, KEY_KP2, 0};
+static int evdev_select3[]  = {KEY_3, KEY_KP3, 0};
+static int evdev_select4[]  = {KEY_4, KEY_KP4, 0};
+static int evdev_select5[]  = {KEY_5, KEY_KP5, 0};
+static int evdev_select6[]  = {KEY_6, KEY_KP6, 0};
+static int evdev_select7[]  = {KEY_7, KEY_KP7, 0};
+static int evdev_select8[]  = {KEY_8, KEY_KP8, 0};
+static int evdev_select9[]  = {KEY_9, KEY_KP9, 0};
+static int evdev_select10[] = {KEY_0, KEY_KP0, 0};
+static int evdev_left[]     = {KEY_LEFT,  BTN_DPAD_LEFT,  0};
+static int evdev_right[]    = {KEY_RIGHT, BTN_DPAD_RIGHT, 0};
+static int evdev_up[]       = {KEY_UP,    BTN_DPAD_UP,    0};
+static int evdev_down[]     = {KEY_DOWN,  BTN_DPAD_DOWN,  0};
+static int evdev_select[]   = {KEY_ENTER, KEY_KPENTER, KEY_SPACE,
+                               BTN_JOYSTICK, BTN_THUMB, BTN_THUMB2, BTN_TOP, BTN_TOP2, BTN_PINKIE,
+                               BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4, BTN_BASE5, BTN_BASE6,
+                               BTN_DEAD, BTN_A, BTN_B, BTN_C, BTN_X, BTN_Y, BTN_Z,
+                               BTN_TL, BTN_TR, BTN_TL2, BTN_TR2, BTN_SELECT, BTN_START, BTN_MODE,
+                               BTN_THUMBL, BTN_THUMBR, 0};
+static int evdev_abort[]    = {KEY_ESC, KEY_Q, 0};
+
+static event_map evdev_event_map = {NULL,
+                                    evdev_select1,
+                                    evdev_select2,
+                                    evdev_select3,
+                                    evdev_select4,
+                                    evdev_select5,
+                                    evdev_select6,
+                                    evdev_select7,
+                                    evdev_select8,
+                                    evdev_select9,
+                                    evdev_select10,
+                                    evdev_left,
+                                    evdev_right,
+                                    evdev_up,
+                                    evdev_down,
+                                    evdev_select,
+                                    evdev_abort};
+
+static void evdev_open(int devNr, const char *devName);
+static void evdev_close(int devNr);
+static int getEvdevEvents(int devNr, input_event *out, int max);
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+    static void handleNotifyEvent();
+#endif
+static input_event abs2Event(uint16_t axisId, int8_t state);
+
+
+int evdev_cfgAddDev(const char *devName)
+{
+    if (!init && (devCnt < INPUT_EVDEV_MAX))
+    {
+        strncpy(devNames[devCnt], devName, EVDEV_NAME_MAX);
+        devNames[devCnt][EVDEV_NAME_MAX-1] = 0; // be shure always be null-terminated
+        ++devCnt;
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+void evdev_cfgScan()
+{
+    if (!init)
+    {
+        scan = 1;
+    }
+}
+
+
+int evdev_init()
+{
+    if (!init)
+    {
+        int devNr;
+
+        key2event_init(evdev_event_map);
+
+        memset(devs, 0, sizeof(devs));
+        for (devNr = 0; devNr < INPUT_EVDEV_MAX; ++devNr)
+        {
+            devs[devNr].fd = -1;
+        }
+
+        init = 1;
+        if (!scan && (devCnt == 0))
+        {
+            return 0;   // not configured, keyboard and joystick drivers only
+        }
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+        notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (notify_fd >= 0)
+        {
+            int wd;
+
+            wd = inotify_add_watch(notify_fd, EVDEV_DIR, IN_ATTRIB | IN_CREATE);
+            if (wd < 0)
+            {
+                debugOut(debug_level0, "Err inotify_add_watch: %d\n", errno);
+            }
+            input_watch(notify_fd, input_driver_evdev, INPUT_EVDEV_MAX);
+        }
+        else
+        {
+            debugOut(debug_level0, "Err inotify_init: %d\n", errno);
+        }
+#endif
+
+        evdev_task();
+
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+/**
+ * @brief Check if a device has any key or button mapped to an event.
+ * @param fd    Open event device.
+ * @return      1 if the device is of use, 0 otherwise.
+ */
+static int hasMappedKey(int fd)
+{
+    unsigned long keyBits[NBITS(KEY_CNT)];
+    int e, n;
+
+    memset(keyBits, 0, sizeof(keyBits));
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0)
+    {
+        return 0;
+    }
+
+    for (e = 0; e < input_event_cnt; ++e)
+    {
+        for (n = 0; (evdev_event_map[e] != NULL) && (evdev_event_map[e][n] != 0); ++n)
+        {
+            if (TEST_BIT(evdev_event_map[e][n], keyBits)) { return 1; }
+        }
+    }
+
+    return 0;
+}
+
+
+static void evdev_open(int devNr, const char *devName)
+{
+    struct input_absinfo absInfo;
+    char name[80] = "";
+    int fd;
+    int i;
+
+    assert(devNr < INPUT_EVDEV_MAX);
+
+    fd = open(devName, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) { return; }
+
+    // scanning must not grab mice, touch screens, power buttons, ...
+    if (scan && !hasMappedKey(fd))
+    {
+        close(fd);
+        return;
+    }
+
+    if (ioctl(fd, EVIOCGRAB, 1) != 0)
+    {
+        if (errno == EBUSY)
+        {
+            debugOut(debug_level2, "Evdev %s grabbed by someone else\n", devName);
+            close(fd);
+            return;
+        }
+        debugOut(debug_level2, "Evdev %s not grabbed: %d\n", devName, errno);
+    }
+
+    devs[devNr].fd = fd;
+    strncpy(devs[devNr].name, devName, EVDEV_NAME_MAX);
+    devs[devNr].name[EVDEV_NAME_MAX-1] = 0;
+
+    // axes are normalized to -1, 0, 1 using their range, e.g. hats are -1..1
+    for (i = 0; i < EVDEV_ABS_CNT; ++i)
+    {
+        devs[devNr].absHalf[i] = 0;
+        devs[devNr].absState[i] = 0;
+        if (   (ioctl(fd, EVIOCGABS(i), &absInfo) == 0)
+            && (absInfo.maximum > absInfo.minimum))
+        {
+            devs[devNr].absMid[i]  = ((int64_t)absInfo.minimum + absInfo.maximum) / 2;
+            devs[devNr].absHalf[i] = ((int64_t)absInfo.maximum - absInfo.minimum + 1) / 2;
+            if (((int64_t)absInfo.value - devs[devNr].absMid[i]) * 2 < -devs[devNr].absHalf[i])
+            {
+                devs[devNr].absState[i] = -1;
+            }
+            else if (((int64_t)absInfo.value - devs[devNr].absMid[i]) * 2 > devs[devNr].absHalf[i])
+            {
+                devs[devNr].absState[i] = 1;
+            }
+        }
+    }
+
+    input_watch(fd, input_driver_evdev, devNr);
+
+    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+    name[sizeof(name) - 1] = 0;
+    debugOut(debug_level2, "Evdev found [%d](%s) fd:%d name:%s\n", devNr, devName, fd, name);
+}
+
+
+/**
+ * @brief Open all new event devices in /dev/input.
+ */
+static void scanDevices()
+{
+    struct dirent *entry;
+    char devName[sizeof(EVDEV_DIR) + sizeof(entry->d_name)];
+    DIR *dir;
+    int devNr, freeNr;
+
+    dir = opendir(EVDEV_DIR);
+    if (dir == NULL) { return; }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "event", 5) != 0) { continue; }
+        snprintf(devName, sizeof(devName), EVDEV_DIR "/%s", entry->d_name);
+
+        freeNr = -1;
+        for (devNr = 0; devNr < INPUT_EVDEV_MAX; ++devNr)
+        {
+            if (devs[devNr].fd < 0)
+            {
+                if (freeNr < 0) { freeNr = devNr; }
+            }
+            else if (strcmp(devs[devNr].name, devName) == 0)
+            {
+                break;  // already open
+            }
+        }
+
+        if ((devNr == INPUT_EVDEV_MAX) && (freeNr >= 0))
+        {
+            evdev_open(freeNr, devName);
+        }
+    }
+
+    closedir(dir);
+}
+
+
+void evdev_task()
+{
+    int devNr;
+
+    if (init)
+    {
+        if (scan)
+        {
+            scanDevices();
+        }
+        for (devNr = 0; !scan && (devNr < devCnt); ++devNr)
+        {
+            if (devs[devNr].fd < 0)
+            {
+                evdev_open(devNr, devNames[devNr]);
+            }
+        }
+    }
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_POLL
+    getCurClock(&lastCycle);
+#endif
+}
+
+
+int evdev_getTaskTimeout()
+{
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_POLL
+    if (init && (scan || (devCnt > 0)))
+    {
+        int to = getTimeout(&lastCycle, taskCycle);
+        if (to < 0)
+        {
+            evdev_task();
+            return taskCycle;
+        }
+        return to;
+    }
+    else
+#endif
+    {
+        return -1;
+    }
+}
+
+
+void evdev_stop()
+{
+    if (init)
+    {
+        int devNr;
+        for (devNr = 0; devNr < INPUT_EVDEV_MAX; ++devNr)
+        {
+            evdev_close(devNr);
+        }
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+        if (notify_fd >= 0)
+        {
+            input_unwatch(notify_fd);
+            close(notify_fd);
+            notify_fd = -1;
+        }
+#endif
+        init = 0;
+    }
+}
+
+
+static void evdev_close(int devNr)
+{
+    assert(devNr < INPUT_EVDEV_MAX);
+
+    if (init)
+    {
+        if (devs[devNr].fd >= 0)
+        {
+            input_unwatch(devs[devNr].fd);
+            close(devs[devNr].fd);  // also releases the grab
+            devs[devNr].fd = -1;
+            devs[devNr].name[0] = 0;
+        }
+    }
+}
+
+
+int evdev_getFd(int devNr)
+{
+    if (init)
+    {
+        if (devNr < INPUT_EVDEV_MAX)
+        {
+            return devs[devNr].fd;
+        }
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+        if (devNr == INPUT_EVDEV_MAX)
+        {
+            return notify_fd;
+        }
+#endif
+
+        return -1;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+
+int evdev_getEvents(int devNr, input_event *out, int max)
+{
+    if (init)
+    {
+        if (devNr < INPUT_EVDEV_MAX)
+        {
+            if (devs[devNr].fd >= 0)
+            {
+                return getEvdevEvents(devNr, out, max);
+            }
+        }
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+        if (devNr == INPUT_EVDEV_MAX)
+        {
+            handleNotifyEvent();
+        }
+#endif
+    }
+
+    return 0;
+}
+
+
+static input_event handleEvdevEvent(int devNr, const struct input_event *event)
+{
+    if (event->type == EV_KEY)
+    {
+        input_event e;
+
+        debugOut(debug_level3, "Evdev %d Key code:%03x value:%d\n",
+            devNr, event->code, event->value);
+        if (event->value == 1)          // press
+        {
+            return key2event(evdev_event_map, event->code);
+        }
+        else if (event->value == 2)     // auto repeat, for moves only
+        {
+            e = key2event(evdev_event_map, event->code);
+            if ((e >= input_left) && (e <= input_down)) { return e; }
+        }
+    }
+    else if ((event->type == EV_ABS) && (event->code < EVDEV_ABS_CNT)
+             && (devs[devNr].absHalf[event->code] > 0))
+    {
+        // same hysteresis as the joystick driver: leave the middle at 3/4
+        // of the range, get back to the middle below 1/4
+        int64_t rel = ((int64_t)event->value - devs[devNr].absMid[event->code]) * 4;
+        int64_t half = devs[devNr].absHalf[event->code];
+        int8_t state = devs[devNr].absState[event->code];
+        int8_t newState = state;
+
+        debugOut(debug_level3, "Evdev %d Abs code:%02x value:%d\n",
+            devNr, event->code, event->value);
+
+        if (state == 0)
+        {
+            if      (rel < -3 * half) { newState = -1; }
+            else if (rel >  3 * half) { newState =  1; }
+        }
+        else if ((state < 0) ? (rel > -half) : (rel < half))
+        {
+            newState = 0;
+        }
+
+        if (newState != state)
+        {
+            devs[devNr].absState[event->code] = newState;
+            return abs2Event(event->code, newState);
+        }
+    }
+
+    return input_none;
+}
+
+
+static int getEvdevEvents(int devNr, input_event *out, int max)
+{
+    struct input_event events[EVDEV_CHUNK];
+    ssize_t retval;
+    int i, cnt = 0;
+
+    // a whole report (keys, axes, SYN) with one read, one event at most per struct
+    if (max > EVDEV_CHUNK) { max = EVDEV_CHUNK; }
+    retval = read(devs[devNr].fd, events, max * sizeof(events[0]));
+
+    if (retval < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EINTR)) { return 0; }
+        debugOut(debug_level0, "Error reading evdev: %d\n", errno); // ENODEV if unplugged
+        evdev_close(devNr);
+    }
+    else if (retval == 0)
+    {
+        debugOut(debug_level0, "NoData from evdev\n");
+        evdev_close(devNr);
+    }
+    else if ((retval % sizeof(events[0])) == 0)
+    {
+        for (i = 0; i < retval / (ssize_t)sizeof(events[0]); ++i)
+        {
+            out[cnt] = handleEvdevEvent(devNr, &events[i]);
+            if (out[cnt] != input_none) { ++cnt; }
+        }
+    }
+    else
+    {
+        debugOut(debug_level0, "Not enough data from evdev\n");
+        evdev_close(devNr);
+    }
+
+    return cnt;
+}
+
+
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+
+static void handleNotifyEvent()
+{
+    char buf[4096];
+
+    while (read(notify_fd, buf, sizeof(buf)) > 0)
+    {
+        // we don't need the data it's just a trigger
+    }
+    evdev_task();
+}
+
+#endif
+
+
+static input_event abs2Event(uint16_t axisId, int8_t state)
+{
+    input_event event = input_none;
+
+    switch (axisId)
+    {
+        case ABS_X:
+        case ABS_RX:
+        case ABS_HAT0X:
+        case ABS_HAT1X:
+        case ABS_HAT2X:
+        case ABS_HAT3X:
+            if      (state == -1) { event = input_left;  }
+            else if (state ==  1) { event = input_right; }
+            break;
+        case ABS_Y:
+        case ABS_RY:
+        case ABS_HAT0Y:
+        case ABS_HAT1Y:
+        case ABS_HAT2Y:
+        case ABS_HAT3Y:
+            if      (state == -1) { event = input_up;   }
+            else if (state ==  1) { event = input_down; }
+            break;
+    }
+
+    return event;
+}
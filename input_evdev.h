@@ -0,0 +1,96 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#ifndef _FRABENU_INPUT_EVDEV_H_
+#define _FRABENU_INPUT_EVDEV_H_
+
+#include "input.h"
+
+#define INPUT_EVDEV_MAX 16
+
+#ifndef FRABENU_JOYMONITORMODE
+    #error "FRABENU_JOYMONITORMODE not defined"
+#elif FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_POLL
+    #define INPUT_EVDEV_MAXFD INPUT_EVDEV_MAX
+#elif FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+    #define INPUT_EVDEV_MAXFD (INPUT_EVDEV_MAX + 1)
+#else
+    #error "unknown value for FRABENU_JOYMONITORMODE"
+#endif
+
+/**
+ * @brief Add new evdev device for monitoring.
+ *
+ * You must call this before evdev_init(). Opened devices are grabbed exclusively,
+ * so their input no longer reaches the console or other programs.
+ * @param devName   Event device e.g. "/dev/input/event0".
+ * @return Returns 0 on success and a value != 0 on error.
+ */
+int evdev_cfgAddDev(const char *devName);
+
+/**
+ * @brief Use all keyboards and gamepads found in /dev/input.
+ *
+ * You must call this before evdev_init(). Only devices with keys or buttons
+ * mapped to events are grabbed, e.g. mice or touch screens are not.
+ * Without this or evdev_cfgAddDev() the evdev driver is not used at all.
+ */
+void evdev_cfgScan();
+
+/**
+ * Init input logic.
+ *
+ * Call this only once or after calling evdev_stop().
+ *
+ * @return Returns 0 on success and a value != 0 on error.
+ *         You should call evdev_stop() even if init fail.
+ */
+int evdev_init();
+
+/**
+ * @brief Task to handle timeouts, monitoring or else.
+ *
+ * Currently you do not call this directly.
+ */
+void evdev_task();
+
+/**
+ * @brief Get timeout until next task call is needed or -1.
+ *
+ * If timeout elapsed, evdev_task() is called.
+ * Use the return vale for blocking functions with timeout.
+ * @return Timeout in ms or -1 if no timeout is running.
+ */
+int  evdev_getTaskTimeout();
+
+/**
+ * Deinit input logic.
+ *
+ * Call this even if init fail to deinit partly initialization.
+ * evdev_stop() do nothing if evdev_init() is not called before.
+ */
+void evdev_stop();
+
+/**
+ * @brief Get file descriptor for a device
+ * @param devNr 0..(INPUT_EVDEV_MAXFD-1)
+ * @return      >=0 for open device or -1 if device is closed.
+ */
+int evdev_getFd(int devNr);
+
+/**
+ * @brief Read all available data from open device (up to max events).
+ *
+ * This may block if there are no data to read.
+ * @param devNr 0..(INPUT_EVDEV_MAXFD-1)
+ * @param out   Array for the events read.
+ * @param max   Size of out, >0.
+ * @return      Number of events in out, may be 0.
+ */
+int evdev_getEvents(int devNr, input_event *out, int max);
+
+#endif // _FRABENU_INPUT_EVDEV_H_
@@ -45,6 +45,8 @@ static char devNames[INPUT_JOY_MAX][PATH_MAX];
 
 #define AX_INIT_STATE 127
 
+#define JOY_CHUNK   32  // max. js_event per read()
+
 static const int16_t THRESHOLDS[3][2] = {
     {INT16_MIN,         NEG_1ST_THRESHOLD},
     {NEG_2ND_THRESHOLD, POS_2ND_THRESHOLD},
@@ -96,7 +98,7 @@ static event_map joy_event_map = {NULL,
                                   NULL};
 
 static void joy_close(int devNr);
-static input_event getJoyEvent(int devNr);
+static int getJoyEvents(int devNr, input_event *out, int max);
 #if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
     static void handleNotifyEvent();
 #endif
@@ -108,7 +110,7 @@ int joy_cfgAddDev(const char *devName)
     if (!init && (devCnt < INPUT_JOY_MAX))
     {
         strncpy(devNames[devCnt], devName, PATH_MAX);
-        devNames[devCnt][PATH_MAX-0] = 0; // be shure always be null-terminated
+        devNames[devCnt][PATH_MAX-1] = 0; // be shure always be null-terminated
         ++devCnt;
         return 0;
     }
@@ -139,6 +141,8 @@ int joy_init()
             joy_cfgAddDev("/dev/input/js9");
         }
 
+        key2event_init(joy_event_map);
+
         memset(joys, 0, sizeof(joys));
         for (devNr = 0; devNr < devCnt; ++devNr)
         {
@@ -157,6 +161,7 @@ int joy_init()
             {
                 debugOut(debug_level0, "Err inotify_add_watch: %d\n", errno);
             }
+            input_watch(notify_fd, input_driver_joy, INPUT_JOY_MAX);
             // TODO also watch /dev/input/by-id and /dev/input/by-path
         }
         else
@@ -189,6 +194,8 @@ void joy_task()
             {
                 int i, x;
 
+                input_watch(joys[devNr].fd, input_driver_joy, devNr);
+
                 debugOut(debug_level2, "Joystick found [%d](%s) fd:%d:\n",
                     devNr, devNames[devNr], joys[devNr].fd);
 
@@ -266,6 +273,14 @@ void joy_stop()
         {
             joy_close(devNr);
         }
+#if FRABENU_JOYMONITORMODE == FRABENU_JOYMONITORMODE_NOTIFY
+        if (notify_fd >= 0)
+        {
+            input_unwatch(notify_fd);
+            close(notify_fd);
+            notify_fd = -1;
+        }
+#endif
         init = 0;
     }
 }
@@ -279,6 +294,7 @@ static void joy_close(int devNr)
     {
         if (joys[devNr].fd >= 0)
         {
+            input_unwatch(joys[devNr].fd);
             close(joys[devNr].fd);
             joys[devNr].fd = -1;
             memset(joys[devNr].axCurState, AX_INIT_STATE, sizeof(joys[devNr].axCurState));
@@ -318,7 +334,7 @@ int joy_getFd(int devNr)
 }
 
 
-input_event joy_getEvent(int devNr)
+int joy_getEvents(int devNr, input_event *out, int max)
 {
     if (init)
     {
@@ -326,7 +342,7 @@ input_event joy_getEvent(int devNr)
         {
             if (joys[devNr].fd >= 0)
             {
-                return getJoyEvent(devNr);
+                return getJoyEvents(devNr, out, max);
             }
         }
 
@@ -338,88 +354,102 @@ input_event joy_getEvent(int devNr)
 #endif
     }
 
-    return input_none;
+    return 0;
 }
 
 
-static input_event getJoyEvent(int devNr)
+static input_event handleJsEvent(int devNr, const struct js_event *event)
 {
-    struct js_event event;
-
-    ssize_t retval;
-
-    retval = read(joys[devNr].fd, &event, sizeof(event));
-
-    if (retval < 0)
-    {
-        debugOut(debug_level0, "Error reading joy: %d\n", errno);
-        joy_close(devNr);
-    }
-    else if (retval == 0)
+    if (event->type == JS_EVENT_BUTTON)
     {
-        debugOut(debug_level0, "NoData from joy\n");
-        joy_close(devNr);
+        debugOut(debug_level3, "Joy %d Btn Time:%x #:%d[%02x] data:%d\n",
+            devNr, event->time, event->number, joys[devNr].btnMap[event->number], event->value);
+        if (event->value)
+        {
+            return key2event(joy_event_map, joys[devNr].btnMap[event->number]);
+        }
     }
-    else if (retval == sizeof(event))
+    else if (event->type == JS_EVENT_AXIS)
     {
-        if (event.type == JS_EVENT_BUTTON)
+        debugOut(debug_level3, "Joy %d Ax Time:%x #:%d[%02x] data:%d\n",
+            devNr, event->time, event->number, joys[devNr].axMap[event->number], event->value);
+
+        if (   (joys[devNr].axCurState[event->number] >= -1)
+            && (joys[devNr].axCurState[event->number] <= 1))
         {
-            debugOut(debug_level3, "Joy %d Btn Time:%x #:%d[%02x] data:%d\n",
-                devNr, event.time, event.number, joys[devNr].btnMap[event.number], event.value);
-            if (event.value)
+            int i = joys[devNr].axCurState[event->number] + 1;
+            int8_t newState = joys[devNr].axCurState[event->number];
+
+            if (event->value < THRESHOLDS[i][0])
             {
-                return key2event(joy_event_map, joys[devNr].btnMap[event.number]);
+                --newState;
+            }
+            else if (event->value > THRESHOLDS[i][1])
+            {
+                ++newState;
+            }
+            if (newState != joys[devNr].axCurState[event->number])
+            {
+                joys[devNr].axCurState[event->number] = newState;
+                debugOut(debug_level3, "NewState %d\n", newState);
+
+                return axes2Event(joys[devNr].axMap[event->number], newState);
             }
         }
-        else if (event.type == JS_EVENT_AXIS)
+    }
+    else if ((JS_EVENT_INIT & event->type) == JS_EVENT_INIT)
+    {
+        if ((event->type & ~JS_EVENT_INIT) == JS_EVENT_AXIS)
         {
-            debugOut(debug_level3, "Joy %d Ax Time:%x #:%d[%02x] data:%d\n",
-                devNr, event.time, event.number, joys[devNr].axMap[event.number], event.value);
-
-            if (   (joys[devNr].axCurState[event.number] >= -1)
-                && (joys[devNr].axCurState[event.number] <= 1))
+            if (joys[devNr].axCurState[event->number] == AX_INIT_STATE)
             {
-                int i = joys[devNr].axCurState[event.number] + 1;
-                int8_t newState = joys[devNr].axCurState[event.number];
-
-                if (event.value < THRESHOLDS[i][0])
+                joys[devNr].axCurVal[event->number] = event->value;
+                if (event->value < NEG_MID_VALLUE)
                 {
-                    --newState;
+                    joys[devNr].axCurState[event->number] = -1;
                 }
-                else if (event.value > THRESHOLDS[i][1])
+                else if (event->value > POS_MID_VALLUE)
                 {
-                    ++newState;
+                    joys[devNr].axCurState[event->number] = 1;
                 }
-                if (newState != joys[devNr].axCurState[event.number])
+                else
                 {
-                    joys[devNr].axCurState[event.number] = newState;
-                    debugOut(debug_level3, "NewState %d\n", newState);
-
-                    return axes2Event(joys[devNr].axMap[event.number], newState);
+                    joys[devNr].axCurState[event->number] = 0;
                 }
             }
         }
-        else if ((JS_EVENT_INIT & event.type) == JS_EVENT_INIT)
+    }
+
+    return input_none;
+}
+
+
+static int getJoyEvents(int devNr, input_event *out, int max)
+{
+    struct js_event events[JOY_CHUNK];
+    ssize_t retval;
+    int i, cnt = 0;
+
+    // all events queued, e.g. a burst of axis events, with one read
+    if (max > JOY_CHUNK) { max = JOY_CHUNK; }
+    retval = read(joys[devNr].fd, events, max * sizeof(events[0]));
+
+    if (retval < 0)
+    {
+        debugOut(debug_level0, "Error reading joy: %d\n", errno);
+        joy_close(devNr);
+    }
+    else if (retval == 0)
+    {
+        debugOut(debug_level0, "NoData from joy\n");
+        joy_close(devNr);
+    }
+    else if ((retval % sizeof(events[0])) == 0)
+    {
+        for (i = 0; i < retval / (ssize_t)sizeof(events[0]); ++i)
         {
-            if ((event.type & ~JS_EVENT_INIT) == JS_EVENT_AXIS)
-            {
-                if (joys[devNr].axCurState[event.number] == AX_INIT_STATE)
-                {
-                    joys[devNr].axCurVal[event.number] = event.value;
-                    if (event.value < NEG_MID_VALLUE)
-                    {
-                        joys[devNr].axCurState[event.number] = -1;
-                    }
-                    else if (event.value > POS_MID_VALLUE)
-                    {
-                        joys[devNr].axCurState[event.number] = 1;
-                    }
-                    else
-                    {
-                        joys[devNr].axCurState[event.number] = 0;
-                    }
-                }
-            }
+            out[cnt] = handleJsEvent(devNr, &events[i]);
+            if (out[cnt] != input_none) { ++cnt; }
         }
     }
     else
@@ -428,7 +458,7 @@ static input_event getJoyEvent(int devNr)
         joy_close(devNr);
     }
 
-    return input_none;
+    return cnt;
 }
 
 
@@ -73,12 +73,14 @@ void joy_stop();
 int joy_getFd(int devNr);
 
 /**
- * @brief Read data from open device and return current input event.
+ * @brief Read all available data from open device (up to max events).
  *
  * This may block if there are no data to read.
  * @param devNr 0..(INPUT_JOY_MAXFD-1)
- * @return      Current input event, may be input_none.
+ * @param out   Array for the events read.
+ * @param max   Size of out, >0.
+ * @return      Number of events in out, may be 0.
  */
-input_event joy_getEvent(int devNr);
+int joy_getEvents(int devNr, input_event *out, int max);
 
 #endif // _FRABENU_INPUT_JOY_H_
@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 typedef enum CSISeqState
@@ -24,7 +25,6 @@ typedef enum CSISeqState
 
 static int  init = 0;
 static CSISeqState curCSISeqState = CSI_none;
-static int kbdPipe[2] = { -1, -1 };  // 0-r, 1-w
 static int escTimeout = 1000; // ms
 static struct timespec startCSI;
 
@@ -33,6 +33,14 @@ static struct timespec startCSI;
 #define CSI_F_FIRST 0x40
 #define CSI_F_LAST  0x7E
 
+#define KBD_CHUNK   64  // max. bytes per read()
+#define KBD_QUEUE   256 // size of key code queue, power of 2
+
+// decoded key codes, written and read by the input thread only
+static uint16_t kbdQueue[KBD_QUEUE];
+static unsigned kbdHead = 0;    // next write
+static unsigned kbdTail = 0;    // next read
+
 typedef struct {
     uint8_t     stdIn;      // normal stdIn data or CSI final byte
     uint16_t    keyCode;    // key code
@@ -101,86 +109,107 @@ static event_map kbd_event_map = {NULL,
                                   kbd_abort};
 
 
-static int16_t map2keyCode(const CSI_F_2_Key *map,  size_t size, int8_t stdIn)
+// stdin byte -> key code, KEY_RESERVED if not mapped
+static uint16_t normalKeyCodes[256];
+static uint16_t csiKeyCodes[256];
+
+static void buildKeyCodes(uint16_t *keyCodes, const CSI_F_2_Key *map, size_t size)
 {
-    int16_t keyCode = KEY_RESERVED;
-    int i;
+    size_t i;
 
-    for (i = 0; i < size; ++i)
+    memset(keyCodes, 0, 256 * sizeof(keyCodes[0]));   // KEY_RESERVED
+    for (i = size; i > 0; --i)  // first match wins
     {
-        if (map[i].stdIn == stdIn)
-        {
-            keyCode = map[i].keyCode;
-            break;
-        }
+        keyCodes[map[i - 1].stdIn] = map[i - 1].keyCode;
     }
-
-    return keyCode;
 }
 
 
-#define normalMap2keyCode(stdIn) map2keyCode(mapNormal_2_KeyCode, MAPNORMAL_2_KEYCODE_COUNT, stdIn)
-#define csi_F_Map2keyCode(stdIn) map2keyCode(mapCSI_F_2_KeyCode,  MAPCSI_F_2_KEYCODE_COUNT,  stdIn)
+#define normalMap2keyCode(stdIn) normalKeyCodes[(uint8_t)(stdIn)]
+#define csi_F_Map2keyCode(stdIn) csiKeyCodes[(uint8_t)(stdIn)]
 
 
-static void readNextStdIn()
+static void queueKey(uint16_t keyCode)
 {
-    uint8_t  keyIn;
-    uint16_t keyOut;
-    ssize_t retval;
+    if (kbdHead - kbdTail >= KBD_QUEUE)
+    {
+        debugOut(debug_level2, "KBD queue full\n");
+        return;
+    }
+    kbdQueue[kbdHead++ & (KBD_QUEUE - 1)] = keyCode;
+}
 
-    retval = read(STDIN_FILENO, &keyIn, sizeof(keyIn));
 
-    if (retval > 0)
+static void parseStdIn(uint8_t keyIn)
+{
+    uint16_t keyOut;
+
+    switch (curCSISeqState)
     {
-        switch (curCSISeqState)
+    case CSI_none:
+        if (keyIn == CSI_1)
+        {
+            curCSISeqState = CSI_ESCread;
+            getCurClock(&startCSI);
+        }
+        else
         {
-        case CSI_none:
-            if (keyIn == CSI_1)
+            keyOut = normalMap2keyCode(keyIn);
+            if (keyOut != KEY_RESERVED)
             {
-                curCSISeqState = CSI_ESCread;
-                getCurClock(&startCSI);
+                queueKey(keyOut);
             }
-            else
+        }
+        break;
+    case CSI_ESCread:
+        if (keyIn == CSI_2)
+        {
+            curCSISeqState = CSI_waitForEnd;
+        }
+        else
+        {
+            keyOut = KEY_ESC;
+            queueKey(keyOut);
+            if (keyIn != CSI_1)
             {
-                keyOut = normalMap2keyCode(keyIn);
+                keyOut = normalMap2keyCode(keyIn);;
                 if (keyOut != KEY_RESERVED)
                 {
-                    write(kbdPipe[1], &keyOut, sizeof(keyOut));
-                }
-            }
-            break;
-        case CSI_ESCread:
-            if (keyIn == CSI_2)
-            {
-                curCSISeqState = CSI_waitForEnd;
-            }
-            else
-            {
-                keyOut = KEY_ESC;
-                write(kbdPipe[1], &keyOut, sizeof(keyOut));
-                if (keyIn != CSI_1)
-                {
-                    keyOut = normalMap2keyCode(keyIn);;
-                    if (keyOut != KEY_RESERVED)
-                    {
-                        write(kbdPipe[1], &keyOut, sizeof(keyOut));
-                    }
-                    curCSISeqState = CSI_none;
+                    queueKey(keyOut);
                 }
+                curCSISeqState = CSI_none;
             }
-            break;
-        case CSI_waitForEnd:
-            if ((keyIn >= CSI_F_FIRST) && (keyIn <= CSI_F_LAST))
+        }
+        break;
+    case CSI_waitForEnd:
+        if ((keyIn >= CSI_F_FIRST) && (keyIn <= CSI_F_LAST))
+        {
+            keyOut = csi_F_Map2keyCode(keyIn);
+            if (keyOut != KEY_RESERVED)
             {
-                keyOut = csi_F_Map2keyCode(keyIn);
-                if (keyOut != KEY_RESERVED)
-                {
-                    write(kbdPipe[1], &keyOut, sizeof(keyOut));
-                }
-                curCSISeqState = CSI_none;
+                queueKey(keyOut);
             }
-            break;
+            curCSISeqState = CSI_none;
+        }
+        break;
+    }
+}
+
+
+static void readNextStdIn()
+{
+    uint8_t keyIn[KBD_CHUNK];
+    ssize_t retval;
+    ssize_t i;
+
+    // all bytes available, a whole CSI sequence usually comes in one read
+    retval = read(STDIN_FILENO, keyIn, sizeof(keyIn));
+
+    if (retval > 0)
+    {
+        for (i = 0; i < retval; ++i)
+        {
+            parseStdIn(keyIn[i]);
         }
     }
     else
@@ -194,16 +223,15 @@ int kbd_init()
 {
     if (!init)
     {
-        int retval;
         char *env;
 
         curCSISeqState = CSI_none;
-        retval = pipe(kbdPipe);
+        kbdHead = kbdTail = 0;
+        buildKeyCodes(normalKeyCodes, mapNormal_2_KeyCode, MAPNORMAL_2_KEYCODE_COUNT);
+        buildKeyCodes(csiKeyCodes, mapCSI_F_2_KeyCode, MAPCSI_F_2_KEYCODE_COUNT);
+        key2event_init(kbd_event_map);
 
-        if(retval)
-        {
-            return -1;
-        }
+        input_watch(STDIN_FILENO, input_driver_kbd, 0);
 
         env = getenv("ESCDELAY");
         if (env != NULL)
@@ -234,8 +262,7 @@ void kbd_task()
     {
         if (curCSISeqState != CSI_none)
         {
-            int16_t keyOut = KEY_ESC;
-            write(kbdPipe[1], &keyOut, sizeof(keyOut));
+            queueKey(KEY_ESC);
             curCSISeqState = CSI_none;
         }
     }
@@ -261,9 +288,8 @@ void kbd_stop()
 {
     if (init)
     {
-        close(kbdPipe[1]);
-        close(kbdPipe[0]);
-        kbdPipe[1] = kbdPipe[0] = -1;
+        input_unwatch(STDIN_FILENO);
+        kbdHead = kbdTail = 0;
         init = 0;
     }
 }
@@ -275,38 +301,47 @@ int kbd_getFd(int devNr)
     {
     case 0:
         return STDIN_FILENO;
-    case 1:
-        return kbdPipe[0];
     default:
         return -1;
     }
 }
 
 
-input_event kbd_getEvent(int devNr)
+int kbd_getEvents(int devNr, input_event *out, int max)
 {
-
     switch (devNr)
     {
     case 0:
         readNextStdIn();
-        return input_none;
-    case 1:
-    {
-        uint16_t keyCode;
-        ssize_t retval;
-        retval = read(kbdPipe[0], &keyCode, sizeof(keyCode));
-        if (retval == sizeof(keyCode))
-        {
-            return key2event(kbd_event_map, keyCode);
-        }
-        else
-        {
-            return input_none;
-        }
-    }
+        return kbd_getQueued(out, max);
     default:
-        return input_none;
+        return 0;
+    }
+}
+
+
+int kbd_pending()
+{
+    if (!init) { return 0; }
+
+    // keys without event are dropped here, kbd_getQueued() would skip them anyway
+    while ((kbdTail != kbdHead) &&
+           (key2event(kbd_event_map, kbdQueue[kbdTail & (KBD_QUEUE - 1)]) == input_none))
+    {
+        ++kbdTail;
     }
+    return kbdHead != kbdTail;
+}
+
 
+int kbd_getQueued(input_event *out, int max)
+{
+    int cnt = 0;
+
+    while ((cnt < max) && (kbdTail != kbdHead))
+    {
+        out[cnt] = key2event(kbd_event_map, kbdQueue[kbdTail++ & (KBD_QUEUE - 1)]);
+        if (out[cnt] != input_none) { ++cnt; }
+    }
+    return cnt;
 }
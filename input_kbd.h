@@ -10,7 +10,7 @@
 
 #include "input.h"
 
-#define INPUT_KBD_MAX 2
+#define INPUT_KBD_MAX 1
 
 /**
  * Init input logic.
@@ -54,12 +54,33 @@ void kbd_stop();
 int kbd_getFd(int devNr);
 
 /**
- * @brief Read data from open device and return current input event.
+ * @brief Read all available data from open device (up to max events).
  *
  * This may block if there are no data to read.
+ * Decoded keys not fitting into out stay queued, see kbd_getQueued().
  * @param devNr 0..(INPUT_KBD_MAX-1)
- * @return      Current input event, may be input_none.
+ * @param out   Array for the events read.
+ * @param max   Size of out, >0.
+ * @return      Number of events in out, may be 0.
  */
-input_event kbd_getEvent(int devNr);
+int kbd_getEvents(int devNr, input_event *out, int max);
+
+/**
+ * @brief Check for decoded keys not yet returned as events.
+ *
+ * Queued keys not mapped to an event are dropped.
+ * @return  1 if kbd_getQueued() returns at least one event, 0 otherwise.
+ */
+int kbd_pending();
+
+/**
+ * @brief Get decoded keys from the queue without reading any device.
+ *
+ * Never blocks.
+ * @param out   Array for the events read.
+ * @param max   Size of out, >0.
+ * @return      Number of events in out, may be 0.
+ */
+int kbd_getQueued(input_event *out, int max);
 
 #endif // _FRABENU_INPUT_KBD_H_
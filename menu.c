@@ -7,10 +7,55 @@
 
 #include "menu.h"
 #include "fbida/fbi.h"
+#include "fbida/fb-gui.h"
+#include "fbida/vt.h"
+#include "cache.h"
+#include "bundle.h"
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 #include "debug.h"
 
+#define MENU_SWITCH_MS 50   // max. delay of a vt switch while waiting for workers
+
+
+typedef enum menu_tile_state
+{
+    menu_tile_empty,    // not loaded yet
+    menu_tile_loading,  // claimed by a worker or menu_img()
+    menu_tile_ready,    // image in imgArr and/or nativeArr
+    menu_tile_failed    // read_image() failed
+} menu_tile_state;
+
+struct menu_loader
+{
+    char            *fileName;  // result of buildFileName()
+    uint8_t         xPos;
+    uint8_t         yPos;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;    // signaled on any tile state change
+    uint8_t         state[9*9]; // menu_tile_state of every tile
+    int             failed;     // a tile failed, only set without lazy
+    int             lazy;       // !=0: a failed tile does not stop the workers
+    int             stop;
+    int             threadCnt;
+    pthread_t       threads[9*9];
+    bundle          *bundle;    // all images from one file or NULL
+    gfxstate        *gfx;       // convert images for this display or NULL
+    menu_scale_mode scale;      // scale images to gfx
+    size_t          budget;     // !=0: max. bytes of loaded tiles, see menu_evict()
+    size_t          used;       // bytes of loaded tiles
+    size_t          bytes[9*9]; // bytes of every loaded tile
+    unsigned long   useTick;
+    unsigned long   lastUse[9*9];   // useTick of last load or access
+    uint8_t         want[9*9];  // shown or next to it, load first and keep it
+    menu_scroll_mode mode;      // scroll mode of the last menu_task()
+    int             handed[2];  // tiles handed out last, still used by the caller
+};
+
 /**menu
  * @brief buildFileName
  * @param fileName
@@ -106,14 +151,446 @@ char *buildFileName(const char *fileName, uint8_t *xPos, uint8_t *yPos)
 }
 
 
+/**
+ * @brief Mark a tile as handed out to the caller, lock must be held.
+ *
+ * The last two tiles handed out are never evicted, so a caller can use
+ * e.g. the images of a transition.
+ * @param l
+ * @param idx   tile index
+ */
+static void menu_use(menu_loader *l, int idx)
+{
+    l->lastUse[idx] = ++l->useTick;
+    if (l->handed[0] != idx)
+    {
+        l->handed[1] = l->handed[0];
+        l->handed[0] = idx;
+    }
+}
+
+
+/**
+ * @brief Free least recently used tiles until the budget is kept, lock must be held.
+ *
+ * Wanted and handed out tiles are kept even if the budget is exceeded.
+ * @param m
+ */
+static void menu_evict(menu *m)
+{
+    menu_loader *l = m->loader;
+    const int cnt = m->xMax * m->yMax;
+    int idx, victim;
+
+    while ((l->budget > 0) && (l->used > l->budget))
+    {
+        victim = -1;
+        for (idx = 0; idx < cnt; ++idx)
+        {
+            if ((l->state[idx] != menu_tile_ready) || l->want[idx] ||
+                (idx == l->handed[0]) || (idx == l->handed[1]))
+            {
+                continue;
+            }
+            if ((victim < 0) || (l->lastUse[idx] < l->lastUse[victim])) { victim = idx; }
+        }
+        if (victim < 0) { break; }
+
+        debugOut(debug_level3, "evict tile %d\n", victim);
+        free_image(m->imgArr[victim]);
+        gfx_image_free(m->nativeArr[victim]);
+        m->imgArr[victim] = NULL;
+        m->nativeArr[victim] = NULL;
+        l->used -= l->bytes[victim];
+        l->bytes[victim] = 0;
+        l->state[victim] = menu_tile_empty;
+    }
+}
+
+
+static int menu_move(menu *m, menu_scroll_mode mode, input_event e);
+
+/**
+ * @brief Mark the current tile and the tiles reached by left, right, up
+ *        and down in the current scroll mode as wanted.
+ *
+ * Workers load wanted tiles first, so the next tile is ready when the
+ * user moves. With a budget only wanted tiles are loaded.
+ * @param m
+ */
+static void menu_want(menu *m)
+{
+    static const input_event moves[] = { input_left, input_right, input_up, input_down };
+    menu_loader *l = m->loader;
+    menu next;
+    int i;
+
+    if (l == NULL) { return; }
+
+    pthread_mutex_lock(&l->lock);
+    memset(l->want, 0, sizeof(l->want));
+    l->want[menu_get(m)] = 1;
+    for (i = 0; i < sizeof(moves) / sizeof(moves[0]); ++i)
+    {
+        next = *m;
+        menu_move(&next, l->mode, moves[i]);
+        l->want[menu_get(&next)] = 1;
+    }
+    menu_evict(m);
+    pthread_cond_broadcast(&l->changed);
+    pthread_mutex_unlock(&l->lock);
+}
+
+
+/**
+ * @brief Load one claimed tile and publish the result.
+ * @param m
+ * @param idx   tile index, must be in state menu_tile_loading
+ * @param str   copy of the file name template to use
+ * @param use   !=0: tile is handed out to the caller, see menu_use()
+ */
+static void menu_loadClaimed(menu *m, int idx, char *str, int use)
+{
+    menu_loader *l = m->loader;
+    struct ida_image *img = NULL;
+    struct gfx_image *gimg;
+    int cacheable = 1;  // 0 if the tile does not match the cache key
+
+    if (l->bundle != NULL)
+    {
+        gimg = NULL;
+        img = bundle_image(l->bundle, idx);
+    }
+    else
+    {
+        if (l->xPos > 0) { str[l->xPos] = '0' + (idx % m->xMax) + 1; }
+        if (l->yPos > 0) { str[l->yPos] = '0' + (idx / m->xMax) + 1; }
+        gimg = cache_load(str);
+        if (gimg == NULL)
+        {
+            debugOut(debug_level3, "try read %s\n", str);
+            img = read_image_bg(str);
+        }
+    }
+
+    // scale once now, never on the navigation path
+    if ((img != NULL) && (l->gfx != NULL) && (l->scale != menu_scale_none))
+    {
+        struct ida_image *scaled = scale_image_to(img, l->gfx->hdisplay, l->gfx->vdisplay,
+                                                  l->scale == menu_scale_fill);
+        if (scaled == NULL)
+        {
+            // out of memory, crop or letterbox as without scaling, but do not
+            // cache it, the cache key is for the scaled tile
+            debugOut(debug_level0, "Err scaling tile %d, not scaled\n", idx);
+            cacheable = 0;
+        }
+        else if (scaled != img)
+        {
+            free_image(img);
+            img = scaled;
+        }
+    }
+
+    // convert once now instead of on every draw, keep RGB only if that fails
+    if ((img != NULL) && (l->gfx != NULL))
+    {
+        gimg = shadow_convert_image(l->gfx, img);
+        if (gimg != NULL)
+        {
+            if ((l->bundle == NULL) && cacheable) { cache_store(str, gimg); }
+            free_image(img);
+            img = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&l->lock);
+    m->imgArr[idx] = img;
+    m->nativeArr[idx] = gimg;
+    if ((img != NULL) || (gimg != NULL))
+    {
+        l->state[idx] = menu_tile_ready;
+        l->bytes[idx] = ((img != NULL) ? img->i.width * img->i.height * 3 : 0) +
+                        ((gimg != NULL) ? gimg->stride * gimg->height : 0);
+        l->used += l->bytes[idx];
+        l->lastUse[idx] = ++l->useTick;
+        if (use) { menu_use(l, idx); }
+        menu_evict(m);
+    }
+    else
+    {
+        // lazy: only this tile is gone, the others are still worth loading
+        l->state[idx] = menu_tile_failed;
+        if (!l->lazy) { l->failed = 1; }
+    }
+    pthread_cond_broadcast(&l->changed);
+    pthread_mutex_unlock(&l->lock);
+}
+
+
+/**
+ * @brief Worker thread, loads empty tiles until all are claimed,
+ *        one failed or the loader is stopped.
+ *
+ * In lazy mode a failed tile is skipped and the others are still loaded.
+ *
+ * With a budget only wanted tiles are loaded and the worker waits for
+ * new ones until the loader is stopped.
+ * @param arg   menu
+ * @return      NULL
+ */
+static void *menu_loadWorker(void *arg)
+{
+    menu *m = arg;
+    menu_loader *l = m->loader;
+    const int cnt = m->xMax * m->yMax;
+    char *str;
+    int idx;
+
+    str = strdup(l->fileName);
+    if (str == NULL)
+    {
+        pthread_mutex_lock(&l->lock);
+        if (!l->lazy) { l->failed = 1; }
+        pthread_mutex_unlock(&l->lock);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&l->lock);
+        for (;;)
+        {
+            // wanted ones first, others only without a budget
+            for (idx = 0; idx < cnt; ++idx)
+            {
+                if ((l->state[idx] == menu_tile_empty) && l->want[idx]) { break; }
+            }
+            if ((idx >= cnt) && (l->budget == 0))
+            {
+                for (idx = 0; idx < cnt; ++idx)
+                {
+                    if (l->state[idx] == menu_tile_empty) { break; }
+                }
+            }
+            if (l->stop || l->failed || (idx < cnt) || (l->budget == 0)) { break; }
+            pthread_cond_wait(&l->changed, &l->lock);
+        }
+        if (l->stop || l->failed || (idx >= cnt))
+        {
+            pthread_mutex_unlock(&l->lock);
+            break;
+        }
+        l->state[idx] = menu_tile_loading;
+        pthread_mutex_unlock(&l->lock);
+
+        menu_loadClaimed(m, idx, str, 0);
+    }
+
+    free(str);
+    return NULL;
+}
+
+
+/**
+ * @brief Start one worker per online cpu for all empty tiles.
+ * @param m
+ */
+static void menu_loadStart(menu *m)
+{
+    menu_loader *l = m->loader;
+    const int cnt = m->xMax * m->yMax;
+    sigset_t all, old;
+    long cpus;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)   { cpus = 1; }
+    if (cpus > cnt) { cpus = cnt; }
+
+    // workers inherit the mask, so signals like the vt switch ones reach the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (l->threadCnt = 0; l->threadCnt < cpus; ++l->threadCnt)
+    {
+        if (pthread_create(&l->threads[l->threadCnt], NULL, menu_loadWorker, m) != 0) { break; }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (l->threadCnt == 0)
+    {
+        menu_loadWorker(m);     // no threads at all, do it on our own
+    }
+}
+
+
+/**
+ * @brief Wait for all workers started by menu_loadStart().
+ * @param m
+ */
+static void menu_loadJoin(menu *m)
+{
+    menu_loader *l = m->loader;
+    int i;
+
+    for (i = 0; i < l->threadCnt; ++i)
+    {
+        pthread_join(l->threads[i], NULL);
+    }
+    l->threadCnt = 0;
+}
+
+
+/**
+ * @brief Wait for a tile state change of the workers, lock must be held.
+ *
+ * Only the main thread waits here. Workers do not get the vt switch
+ * signals, so they are handled here instead of after a long decode.
+ * @param l
+ */
+static void menu_waitChanged(menu_loader *l)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += MENU_SWITCH_MS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&l->changed, &l->lock, &ts);
+
+    // the redraw of a switch may load tiles on its own
+    pthread_mutex_unlock(&l->lock);
+    check_console_switch();
+    pthread_mutex_lock(&l->lock);
+}
+
+
+/**
+ * @brief Wait until all tiles are loaded or one failed.
+ * @param m
+ */
+static void menu_loadWait(menu *m)
+{
+    menu_loader *l = m->loader;
+    const int cnt = m->xMax * m->yMax;
+    int idx = 0;
+
+    pthread_mutex_lock(&l->lock);
+    while ((idx < cnt) && !l->failed)
+    {
+        if ((l->state[idx] == menu_tile_empty) || (l->state[idx] == menu_tile_loading))
+        {
+            menu_waitChanged(l);
+        }
+        else
+        {
+            ++idx;
+        }
+    }
+    pthread_mutex_unlock(&l->lock);
+}
+
+
+/**
+ * @brief Make sure a tile is loaded, load it synchronously if no worker did.
+ * @param m
+ * @param idx   tile index
+ * @return      0 on success, -1 on error.
+ */
+static int menu_loadTile(menu *m, int idx)
+{
+    menu_loader *l = m->loader;
+    int retval;
+
+    pthread_mutex_lock(&l->lock);
+    while (l->state[idx] == menu_tile_loading)
+    {
+        menu_waitChanged(l);
+    }
+    if (l->state[idx] == menu_tile_empty)
+    {
+        char *str = strdup(l->fileName);
+
+        if (str != NULL)
+        {
+            l->state[idx] = menu_tile_loading;
+            pthread_mutex_unlock(&l->lock);
+            menu_loadClaimed(m, idx, str, 1);
+            free(str);
+            pthread_mutex_lock(&l->lock);
+        }
+    }
+    else if (l->state[idx] == menu_tile_ready)
+    {
+        menu_use(l, idx);
+        menu_evict(m);
+    }
+    retval = (l->state[idx] == menu_tile_ready) ? 0 : -1;
+    pthread_mutex_unlock(&l->lock);
+
+    return retval;
+}
+
+
+/**
+ * @brief Check all tile files are readable without decoding them.
+ * @param m
+ * @return      0 if all are readable, -1 else.
+ */
+static int menu_checkFiles(menu *m)
+{
+    menu_loader *l = m->loader;
+    const int cnt = m->xMax * m->yMax;
+    int idx;
+    int retval = 0;
+
+    for (idx = 0; (idx < cnt) && (retval == 0); ++idx)
+    {
+        if (l->xPos > 0) { l->fileName[l->xPos] = '0' + (idx % m->xMax) + 1; }
+        if (l->yPos > 0) { l->fileName[l->yPos] = '0' + (idx / m->xMax) + 1; }
+        if (access(l->fileName, R_OK) != 0)
+        {
+            debugOut(debug_level0, "can't read %s\n", l->fileName);
+            retval = -1;
+        }
+    }
+
+    return retval;
+}
+
+
+/**
+ * @brief Check the bundle matches the menu.
+ * @param m
+ * @return      0 on success, -1 if the bundle does not match the menu.
+ */
+static int menu_checkBundle(menu *m)
+{
+    uint8_t xMax, yMax;
+
+    bundle_layout(m->loader->bundle, &xMax, &yMax);
+    if ((xMax != m->xMax) || (yMax != m->yMax))
+    {
+        debugOut(debug_level0, "bundle layout is %dx%d\n", xMax, yMax);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 menu *menu_creat(uint8_t xMax, uint8_t yMax, const char *fileName)
+{
+    return menu_creat_cfg(xMax, yMax, fileName, NULL);
+}
+
+
+menu *menu_creat_cfg(uint8_t xMax, uint8_t yMax, const char *fileName, const menu_cfg *cfg)
 {
     menu *m;
-    uint8_t xPos;
-    uint8_t yPos;
-    uint8_t x, y;
-    char *str;
-    struct ida_image *img;
+    menu_loader *l;
 
     debugOut(debug_level3, "menu_creat(%d, %d, %s)\n", xMax, yMax, fileName);
 
@@ -127,30 +604,57 @@ menu *menu_creat(uint8_t xMax, uint8_t yMax, const char *fileName)
     m->yMax = yMax;
 
     m->imgArr = calloc(xMax * yMax, sizeof(m->imgArr));
+    if (m->imgArr == NULL) { return menu_destroy(m); }
 
-    xPos = (xMax == 1) ? 0 : 1;
-    yPos = (yMax == 1) ? 0 : 1;
-    str = buildFileName(fileName, &xPos, &yPos);
-    if (str == NULL) { return menu_destroy(m); }
+    m->nativeArr = calloc(xMax * yMax, sizeof(m->nativeArr));
+    if (m->nativeArr == NULL) { return menu_destroy(m); }
 
-    for (y = 0; y < yMax; ++y)
+    l = m->loader = calloc(1, sizeof(menu_loader));
+    if (l == NULL) { return menu_destroy(m); }
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->changed, NULL);
+    l->handed[0] = l->handed[1] = -1;
+
+    if (cfg != NULL)
     {
-        for (x = 0; x < xMax; ++x)
-        {
-            if (xPos > 0) { str[xPos] = '0' + x + 1; }
-            if (yPos > 0) { str[yPos] = '0' + y + 1; }
-            debugOut(debug_level3, "try read %s\n", str);
-            img = read_image(str);
-            if (img == NULL)
-            {
-                free(str);
-                return menu_destroy(m);
-            }
-            m->imgArr[y*xMax + x] = img;
-        }
+        l->gfx = cfg->gfx;
+        l->scale = cfg->scale;
+        l->budget = cfg->budget;
+        menu_set(m, cfg->select);
     }
 
-    free(str);
+    // one mapped file instead of decoding every single image
+    l->bundle = bundle_open(fileName);
+    if (l->bundle != NULL)
+    {
+        if (menu_checkBundle(m) != 0) { return menu_destroy(m); }
+        l->xPos = l->yPos = 0;
+        l->fileName = strdup(fileName);
+    }
+    else
+    {
+        l->xPos = (xMax == 1) ? 0 : 1;
+        l->yPos = (yMax == 1) ? 0 : 1;
+        l->fileName = buildFileName(fileName, &l->xPos, &l->yPos);
+    }
+    if (l->fileName == NULL) { return menu_destroy(m); }
+
+    if ((cfg != NULL) && (cfg->lazy || (cfg->budget > 0)))
+    {
+        // decode only what is shown first, everything else in background
+        if ((l->bundle == NULL) && (menu_checkFiles(m) != 0)) { return menu_destroy(m); }
+        l->lazy = 1;
+        if (menu_loadTile(m, menu_get(m)) != 0) { return menu_destroy(m); }
+        menu_want(m);
+        menu_loadStart(m);
+    }
+    else
+    {
+        menu_loadStart(m);
+        menu_loadWait(m);
+        menu_loadJoin(m);
+        if (l->failed) { return menu_destroy(m); }
+    }
 
     return m;
 }
@@ -160,6 +664,14 @@ menu *menu_destroy(menu * m)
 {
     if (m != NULL)
     {
+        if (m->loader != NULL)
+        {
+            pthread_mutex_lock(&m->loader->lock);
+            m->loader->stop = 1;
+            pthread_cond_broadcast(&m->loader->changed);
+            pthread_mutex_unlock(&m->loader->lock);
+            menu_loadJoin(m);
+        }
         if (m->imgArr != NULL)
         {
             uint8_t x, y;
@@ -167,14 +679,28 @@ menu *menu_destroy(menu * m)
             {
                 for (x = 0; x < m->xMax; ++x)
                 {
-                    if (m->imgArr[y*m->xMax + x] != NULL)
-                    {
-                        free(m->imgArr[y*m->xMax + x]);
-                    }
+                    free_image(m->imgArr[y*m->xMax + x]);
                 }
             }
             free(m->imgArr);
         }
+        if (m->nativeArr != NULL)
+        {
+            int i;
+            for (i = 0; i < m->xMax * m->yMax; ++i)
+            {
+                gfx_image_free(m->nativeArr[i]);
+            }
+            free(m->nativeArr);
+        }
+        if (m->loader != NULL)
+        {
+            bundle_close(m->loader->bundle);    // after all images
+            pthread_cond_destroy(&m->loader->changed);
+            pthread_mutex_destroy(&m->loader->lock);
+            free(m->loader->fileName);
+            free(m->loader);
+        }
         free(m);
     }
     return NULL;
@@ -196,22 +722,85 @@ void menu_set(menu *m , int select)
     {
         m->curX = select % m->xMax;
         m->curY = y;
+        menu_want(m);
     }
 }
 
 struct ida_image * menu_img(menu * m)
+{
+    return menu_img_at(m, menu_get(m));
+}
+
+struct gfx_image * menu_native(menu * m)
+{
+    return menu_native_at(m, menu_get(m));
+}
+
+struct ida_image * menu_img_at(menu * m, int idx)
 {
     if (m == NULL) { return NULL; }
     if (m->imgArr == NULL) { return NULL; }
-    return m->imgArr[menu_get(m)];
+    if ((idx < 0) || (idx >= m->xMax * m->yMax)) { return NULL; }
+    if ((m->loader != NULL) && (menu_loadTile(m, idx) != 0)) { return NULL; }
+    return m->imgArr[idx];
+}
+
+struct gfx_image * menu_native_at(menu * m, int idx)
+{
+    if (m == NULL) { return NULL; }
+    if (m->nativeArr == NULL) { return NULL; }
+    if ((idx < 0) || (idx >= m->xMax * m->yMax)) { return NULL; }
+    if ((m->loader != NULL) && (menu_loadTile(m, idx) != 0)) { return NULL; }
+    return m->nativeArr[idx];
+}
+
+
+int menu_loaded(menu * m, int idx)
+{
+    int retval;
+
+    if (m == NULL) { return -1; }
+    if ((idx < 0) || (idx >= m->xMax * m->yMax)) { return -1; }
+    if (m->loader == NULL) { return 1; }
+
+    pthread_mutex_lock(&m->loader->lock);
+    retval = (m->loader->state[idx] == menu_tile_ready) ? 1 : 0;
+    pthread_mutex_unlock(&m->loader->lock);
+
+    return retval;
 }
 
 
 int menu_task(menu * m, menu_scroll_mode mode, input_event e)
 {
-    int select = -1;
+    int select, idx;
     if (m == NULL) { return 0; }
 
+    idx = menu_get(m);
+    select = menu_move(m, mode, e);
+
+    // most events do not move the marker, the wanted tiles stay the same then
+    if ((m->loader != NULL) && ((menu_get(m) != idx) || (m->loader->mode != mode)))
+    {
+        m->loader->mode = mode;
+        menu_want(m);
+    }
+
+    return select;
+}
+
+
+/**
+ * @brief Move the marker, see menu_task().
+ * @param m
+ * @param mode  Scroll mode
+ * @param e     Input event
+ * @return      same as menu_task()
+ */
+static int menu_move(menu *m, menu_scroll_mode mode, input_event e)
+{
+    int select = -1;
+
     switch (e)
     {
     case input_select1:
@@ -9,7 +9,11 @@
 #define _FRABENU_MENU_H_
 
 #include "input.h"
+#include "fbida/gfx.h"
 #include <stdint.h>
+#include <stddef.h>
+
+typedef struct menu_loader menu_loader;
 
 typedef struct menu
 {
@@ -18,6 +22,8 @@ typedef struct menu
     int8_t curX;    // cur marker
     int8_t curY;
     struct ida_image **imgArr;
+    struct gfx_image **nativeArr;   // images in framebuffer format
+    menu_loader *loader;
 } menu;
 
 typedef enum menu_scroll_mode
@@ -28,15 +34,49 @@ typedef enum menu_scroll_mode
     menu_scroll_mode_4  // roll through all
 } menu_scroll_mode;
 
+typedef enum menu_scale_mode
+{
+    menu_scale_none,    // keep size, crop or letterbox on draw
+    menu_scale_fit,     // scale to fit the display, letterbox
+    menu_scale_fill     // scale to cover the display, crop
+} menu_scale_mode;
+
+typedef struct menu_cfg
+{
+    int select;     // initial selection 1..(xMax*yMax), <=0 for default
+    int lazy;       // !=0: decode only the selected image before returning,
+                    //      load the others in background
+    gfxstate *gfx;  // !=NULL: convert images to the framebuffer format while
+                    //         loading, see menu_native(), shadow_init() needed
+    menu_scale_mode scale;  // scale images to gfx once while loading,
+                            // only the scaled image is kept, needs gfx
+    size_t budget;  // !=0: max. bytes of loaded tiles (implies lazy), least
+                    //      recently used tiles are freed and loaded again on demand,
+                    //      the current tile and its neighbours are loaded in background
+} menu_cfg;
+
 /**
  * @brief menu_creat
  * @param xMax  1..9
  * @param yMax  1..9
- * @param fileName something like "menu_%x_%y.png"
+ * @param fileName something like "menu_%x_%y.png" or a bundle file
  * @return      New menu struct or NULL on error.
  */
 menu *menu_creat(uint8_t xMax, uint8_t yMax, const char *fileName);
 
+/**
+ * @brief Same as menu_creat() but with extra configuration.
+ *
+ * In lazy mode missing files are still detected here, but a file that
+ * fails to decode in background results in menu_img() returning NULL.
+ * @param xMax  1..9
+ * @param yMax  1..9
+ * @param fileName something like "menu_%x_%y.png" or a bundle file
+ * @param cfg   Configuration or NULL for defaults.
+ * @return      New menu struct or NULL on error.
+ */
+menu *menu_creat_cfg(uint8_t xMax, uint8_t yMax, const char *fileName, const menu_cfg *cfg);
+
 /**
  * @brief menu_destroy
  * @param m     Pointer of menu struct on heap to free
@@ -60,11 +100,51 @@ void menu_set(menu *m , int select);
 
 /**
  * @brief Get currenly marked image.
+ *
+ * If the image is not loaded yet, this blocks until it is.
  * @param m
- * @return      Image or NULL on error.
+ * @return      Image or NULL on error or if it is only available
+ *              in framebuffer format, see menu_native().
  */
 struct ida_image * menu_img(menu * m);
 
+/**
+ * @brief Get currenly marked image in framebuffer format.
+ *
+ * If the image is not loaded yet, this blocks until it is.
+ * @param m
+ * @return      Image or NULL on error or if it was not converted.
+ */
+struct gfx_image * menu_native(menu * m);
+
+/**
+ * @brief Same as menu_img() but for any menu index.
+ *
+ * With a budget the image stays valid until two other tiles were requested.
+ * @param m
+ * @param idx   0..(xMax*yMax-1), see menu_get()
+ * @return      Image or NULL
+ */
+struct ida_image * menu_img_at(menu * m, int idx);
+
+/**
+ * @brief Same as menu_native() but for any menu index.
+ *
+ * With a budget the image stays valid until two other tiles were requested.
+ * @param m
+ * @param idx   0..(xMax*yMax-1), see menu_get()
+ * @return      Image or NULL
+ */
+struct gfx_image * menu_native_at(menu * m, int idx);
+
+/**
+ * @brief Check if a tile is loaded, without waiting or loading it.
+ * @param m
+ * @param idx   0..(xMax*yMax-1), see menu_get()
+ * @return      1 if loaded, 0 if not (yet), -1 on error
+ */
+int menu_loaded(menu * m, int idx);
+
 /**
  * @brief Handle input event.
  * @param m
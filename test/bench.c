@@ -0,0 +1,443 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "../input.h"
+#include "../timer.h"
+#include "../fbida/fbi.h"
+#include "../fbida/fb-gui.h"
+#include "../fbida/memtools.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <limits.h>
+#include <linux/input.h>
+
+#define BENCH_REPEAT        5       // measure this often, the fastest run counts
+#define BENCH_MIN_MS        250     // default min. time per benchmark
+#define BENCH_WIDTH         1280    // display size for draw/render benchmarks
+#define BENCH_HEIGHT        720
+#define BENCH_KEYS          256     // key2event lookups per iteration
+
+typedef void (*bench_fn)(void *arg);
+
+static bool jsonOut  = false;
+static int  minMs    = BENCH_MIN_MS;
+static int  benchCnt = 0;
+
+static const struct
+{
+    uint32_t width;
+    uint32_t height;
+} loadSizes[] = { {64, 64}, {320, 240}, {1280, 720} };
+
+
+static long getElapsedNs(const struct timespec *start)
+{
+    struct timespec cur;
+
+    getCurClock(&cur);
+    return (cur.tv_sec - start->tv_sec) * 1000000000L + (cur.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Measure one benchmark and print the result.
+ *
+ * The iteration count is doubled until one run takes at least minMs / BENCH_REPEAT.
+ * Then the run is repeated BENCH_REPEAT times and the fastest one is reported.
+ * @param name      Benchmark name.
+ * @param fn        Function to measure.
+ * @param arg       Argument passed to fn.
+ * @param items     Items (pixels or lookups) processed by one call of fn.
+ * @param unit      Name of an item.
+ * @param bytes     Output bytes produced by one call of fn, 0 if not meaningful.
+ */
+static void bench_run(const char *name, bench_fn fn, void *arg,
+                      unsigned long items, const char *unit, unsigned long bytes)
+{
+    struct timespec start;
+    long iter = 1, i, ns, best = -1;
+    int r;
+    double nsPerIter, mbPerS;
+
+    fn(arg);    // warm up caches
+
+    for (;;)
+    {
+        getCurClock(&start);
+        for (i = 0; i < iter; ++i) { fn(arg); }
+        ns = getElapsedNs(&start);
+        if ((ns >= minMs * 1000000L / BENCH_REPEAT) || (iter >= (1L << 30))) { break; }
+        iter *= 2;
+    }
+
+    for (r = 0; r < BENCH_REPEAT; ++r)
+    {
+        getCurClock(&start);
+        for (i = 0; i < iter; ++i) { fn(arg); }
+        ns = getElapsedNs(&start);
+        if ((best < 0) || (ns < best)) { best = ns; }
+    }
+
+    nsPerIter = (double)best / iter;
+    mbPerS    = (bytes > 0) ? (bytes * 1000.0 / nsPerIter) : 0.0;
+
+    if (jsonOut)
+    {
+        printf("%s\n  {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_iter\": %.1f, "
+               "\"unit\": \"%s\", \"ns_per_%s\": %.3f, \"mb_per_s\": %.1f}",
+               (benchCnt > 0) ? "," : "", name, iter, nsPerIter,
+               unit, unit, nsPerIter / items, mbPerS);
+    }
+    else
+    {
+        if (benchCnt == 0)
+        {
+            printf("%-36s %10s %14s %12s %10s\n", "benchmark", "iter", "ns/iter", "ns/item", "MB/s");
+        }
+        printf("%-36s %10ld %14.1f %8.3f/%-3s ", name, iter, nsPerIter, nsPerIter / items, unit);
+        if (bytes > 0) { printf("%10.1f\n", mbPerS); }
+        else           { printf("%10s\n", "-"); }
+    }
+    fflush(stdout);
+    ++benchCnt;
+}
+
+/* ---------------------------------------------------------------------- */
+/* loaders                                                                */
+
+/**
+ * @brief Fill a RGB buffer with a deterministic pattern.
+ *
+ * Gradients with some noise, so compressing loaders have real work to do.
+ */
+static void fillPattern(uint8_t *rgb, uint32_t width, uint32_t height, uint32_t stride)
+{
+    uint32_t x, y, seed = 12345;
+    uint8_t *line;
+
+    for (y = 0; y < height; ++y)
+    {
+        line = rgb + y * stride;
+        for (x = 0; x < width; ++x)
+        {
+            seed = seed * 1103515245 + 12345;
+            line[x * 3 + 0] = (x * 255 / width) ^ ((seed >> 16) & 0x0f);
+            line[x * 3 + 1] = (y * 255 / height);
+            line[x * 3 + 2] = ((x + y) & 0xff) ^ ((seed >> 24) & 0x07);
+        }
+    }
+}
+
+static int writePPM(const char *fileName, const uint8_t *rgb, uint32_t width, uint32_t height)
+{
+    FILE *fp = fopen(fileName, "wb");
+    int ok;
+
+    if (fp == NULL) { return -1; }
+    fprintf(fp, "P6\n%u %u\n255\n", width, height);
+    ok = fwrite(rgb, width * 3, height, fp) == height;
+    return ((fclose(fp) == 0) && ok) ? 0 : -1;
+}
+
+static void putLE(uint8_t *p, uint32_t v, int bytes)
+{
+    while (bytes-- > 0) { *p++ = v & 0xff; v >>= 8; }
+}
+
+static int writeBMP(const char *fileName, const uint8_t *rgb, uint32_t width, uint32_t height)
+{
+    uint32_t stride = (width * 3 + 3) & ~3;
+    uint8_t hdr[54] = { 'B', 'M' };
+    uint8_t *line;
+    uint32_t x, y;
+    FILE *fp = fopen(fileName, "wb");
+    int ok = 1;
+
+    if (fp == NULL) { return -1; }
+    putLE(hdr +  2, sizeof(hdr) + stride * height, 4);
+    putLE(hdr + 10, sizeof(hdr), 4);
+    putLE(hdr + 14, 40, 4);
+    putLE(hdr + 18, width, 4);
+    putLE(hdr + 22, height, 4);
+    putLE(hdr + 26, 1, 2);
+    putLE(hdr + 28, 24, 2);
+    putLE(hdr + 34, stride * height, 4);
+    ok = fwrite(hdr, sizeof(hdr), 1, fp) == 1;
+
+    line = calloc(1, stride);
+    for (y = height; ok && (line != NULL) && (y-- > 0); )
+    {
+        for (x = 0; x < width; ++x)
+        {
+            // bottom up, BGR
+            line[x * 3 + 0] = rgb[(y * width + x) * 3 + 2];
+            line[x * 3 + 1] = rgb[(y * width + x) * 3 + 1];
+            line[x * 3 + 2] = rgb[(y * width + x) * 3 + 0];
+        }
+        ok = fwrite(line, stride, 1, fp) == 1;
+    }
+    ok = ok && (line != NULL);
+    free(line);
+    return ((fclose(fp) == 0) && ok) ? 0 : -1;
+}
+
+static void benchLoad(void *arg)
+{
+    struct ida_image *img = read_image_bg((char *)arg);
+
+    if (img != NULL) { free_image(img); }
+}
+
+static void benchLoadFile(const char *name, char *fileName)
+{
+    struct ida_image *img = read_image_bg(fileName);
+    unsigned long pixels;
+
+    if (img == NULL)
+    {
+        fprintf(stderr, "can't load %s, skipped\n", fileName);
+        return;
+    }
+    pixels = img->i.width * img->i.height;
+    free_image(img);
+    bench_run(name, benchLoad, fileName, pixels, "px", pixels * 3);
+}
+
+/**
+ * @brief Loader benchmarks with generated PPM and BMP files and all files given.
+ */
+static void benchLoaders(char **files, int fileCnt)
+{
+    static const char * const types[] = { "ppm", "bmp" };
+    char dir[] = "/tmp/frabenu_bench_XXXXXX";
+    char fileName[PATH_MAX];
+    char name[PATH_MAX + 16];
+    uint32_t w, h;
+    uint8_t *rgb;
+    int s, t, f;
+
+    if (mkdtemp(dir) != NULL)
+    {
+        for (s = 0; s < sizeof(loadSizes) / sizeof(loadSizes[0]); ++s)
+        {
+            w = loadSizes[s].width;
+            h = loadSizes[s].height;
+            rgb = malloc(w * h * 3);
+            if (rgb == NULL) { continue; }
+            fillPattern(rgb, w, h, w * 3);
+
+            for (t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+            {
+                snprintf(fileName, sizeof(fileName), "%s/%ux%u.%s", dir, w, h, types[t]);
+                if (((t == 0) ? writePPM(fileName, rgb, w, h) : writeBMP(fileName, rgb, w, h)) == 0)
+                {
+                    snprintf(name, sizeof(name), "read_image/%s/%ux%u", types[t], w, h);
+                    benchLoadFile(name, fileName);
+                }
+                unlink(fileName);
+            }
+            free(rgb);
+        }
+        rmdir(dir);
+    }
+    else
+    {
+        perror("mkdtemp");
+    }
+
+    // other formats need an encoder, the user has to provide such files
+    for (f = 0; f < fileCnt; ++f)
+    {
+        strncpy(fileName, files[f], sizeof(fileName) - 1);
+        fileName[sizeof(fileName) - 1] = '\0';
+        snprintf(name, sizeof(name), "read_image/%s", basename(fileName));
+        benchLoadFile(name, files[f]);
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* draw and render                                                        */
+
+typedef struct
+{
+    gfxstate *gfx;
+    struct ida_image *img;
+    uint8_t *rgb;
+} gfx_arg;
+
+static void benchDraw(void *arg)
+{
+    gfx_arg *a = arg;
+
+    shadow_draw_image(a->gfx, a->img, 0, 0, 0, a->gfx->vdisplay - 1, 100);
+}
+
+static void benchRender(void *arg)
+{
+    gfx_arg *a = arg;
+
+    shadow_set_dirty();
+    shadow_render(a->gfx);
+}
+
+static void benchMerge(void *arg)
+{
+    gfx_arg *a = arg;
+    int y;
+
+    for (y = 0; y < a->gfx->vdisplay; ++y)
+    {
+        shadow_merge_rgbdata(0, y, a->gfx->hdisplay, 50, a->rgb + y * a->gfx->hdisplay * 3);
+    }
+}
+
+static void benchDarkify(void *arg)
+{
+    gfx_arg *a = arg;
+
+    shadow_darkify(0, a->gfx->hdisplay - 1, 0, a->gfx->vdisplay - 1, 50);
+}
+
+static void benchGfx(void)
+{
+    static const uint32_t bpps[] = { 16, 24, 32 };
+    unsigned long pixels = BENCH_WIDTH * BENCH_HEIGHT;
+    char name[64];
+    gfx_arg a;
+    int i;
+
+    a.rgb = malloc(pixels * 3);
+    if (a.rgb == NULL) { return; }
+    fillPattern(a.rgb, BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 3);
+    a.img = map_image(BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 3, a.rgb);
+
+    for (i = 0; (a.img != NULL) && (i < sizeof(bpps) / sizeof(bpps[0])); ++i)
+    {
+        a.gfx = mem_init(BENCH_WIDTH, BENCH_HEIGHT, bpps[i], NULL);
+        if (a.gfx == NULL) { continue; }
+        shadow_init(a.gfx);
+        benchDraw(&a);
+
+        if (i == 0)
+        {
+            // shadow only, independent of the display format
+            bench_run("shadow_draw_image", benchDraw, &a, pixels, "px", pixels * 3);
+            bench_run("shadow_merge_rgbdata", benchMerge, &a, pixels, "px", pixels * 3);
+            bench_run("shadow_darkify", benchDarkify, &a, pixels, "px", pixels * 3);
+        }
+
+        snprintf(name, sizeof(name), "shadow_render/%ubpp", bpps[i]);
+        bench_run(name, benchRender, &a, pixels, "px", pixels * a.gfx->bits_per_pixel / 8);
+
+        shadow_fini();
+        a.gfx->cleanup_display();
+        free(a.gfx);
+    }
+
+    if (a.img != NULL) { free_image(a.img); }
+    free(a.rgb);
+}
+
+/* ---------------------------------------------------------------------- */
+/* input                                                                  */
+
+static int key_select1[] = {KEY_1, 0};
+static int key_select2[] = {KEY_2, 0};
+static int key_select3[] = {KEY_3, 0};
+static int key_select4[] = {KEY_4, 0};
+static int key_select5[] = {KEY_5, 0};
+static int key_select6[] = {KEY_6, 0};
+static int key_select7[] = {KEY_7, 0};
+static int key_select8[] = {KEY_8, 0};
+static int key_select9[] = {KEY_9, 0};
+static int key_select10[] = {KEY_0, 0};
+static int key_left[]    = {KEY_LEFT,  0};
+static int key_right[]   = {KEY_RIGHT, 0};
+static int key_up[]      = {KEY_UP,    0};
+static int key_down[]    = {KEY_DOWN,  0};
+static int key_select[]  = {KEY_ENTER, KEY_SPACE, 0};
+static int key_abort[]   = {KEY_ESC, KEY_Q, 0};
+
+// same layout as the keyboard map
+static event_map bench_event_map = {NULL,
+                                    key_select1, key_select2, key_select3, key_select4,
+                                    key_select5, key_select6, key_select7, key_select8,
+                                    key_select9, key_select10,
+                                    key_left, key_right, key_up, key_down,
+                                    key_select, key_abort};
+
+static volatile int keySink;
+
+static void benchKey2event(void *arg)
+{
+    int k, sum = 0;
+
+    // all key codes below BENCH_KEYS, mapped and unmapped ones
+    for (k = 0; k < BENCH_KEYS; ++k) { sum += key2event(bench_event_map, k); }
+    keySink = sum;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void usage(const char *progName)
+{
+    printf("Usage: %s [options] [image ...]\n", progName);
+    printf("Micro benchmarks for loaders and render code.\n");
+    printf("PPM and BMP files are generated, images given are loaded as well.\n\n");
+    printf("  -h, --help     Show this help and exit.\n");
+    printf("  -j, --json     Write results as JSON.\n");
+    printf("  -t, --time MS  Min. time per benchmark in ms, default is %d.\n", BENCH_MIN_MS);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option longOpts[] = {
+        {"help", no_argument,       NULL, 'h'},
+        {"json", no_argument,       NULL, 'j'},
+        {"time", required_argument, NULL, 't'},
+        {NULL,   0,                 NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "hjt:", longOpts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case 'j':
+                jsonOut = true;
+                break;
+            case 't':
+                minMs = atoi(optarg);
+                if (minMs <= 0)
+                {
+                    fprintf(stderr, "invalid time %s\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (jsonOut) { printf("["); }
+
+    benchLoaders(argv + optind, argc - optind);
+    benchGfx();
+    bench_run("key2event", benchKey2event, NULL, BENCH_KEYS, "key", 0);
+
+    if (jsonOut) { printf("\n]\n"); }
+
+    return 0;
+}
@@ -6,9 +6,26 @@
  * *******************************************/
 
 #include "../menu.h"
+#include "../cache.h"
+#include "../bundle.h"
+#include "../transition.h"
+#include "../trace.h"
+#include "../input.h"
+#include "../input_evdev.h"
+#include "../timer.h"
+#include "../fbida/fbi.h"
+#include "../fbida/fb-simd.h"
+#include "../fbida/memtools.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+#include <limits.h>
+#include <signal.h>
 
 
 #define ASSERT_EX(expr, ex)     if (!(expr)) \
@@ -99,6 +116,1327 @@ int test_menu_creat()
     m = menu_destroy(m);
     ASSERT(m == NULL);
 
+    // third row does not exist
+    m = menu_creat(xMax, 3, fn);
+    ASSERT(m == NULL);
+
+    return err;
+}
+
+int test_menu_creat_lazy()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    int i;
+
+    uint8_t xMax = 3;
+    uint8_t yMax = 2;
+    char fn[] = "menu_%x_%y.png";
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.lazy = 1;
+    cfg.select = 5;
+    m = menu_creat_cfg(xMax, yMax, fn, &cfg);
+    ASSERT(m != NULL);
+    ASSERT_INTEQ(m->curX, 1);
+    ASSERT_INTEQ(m->curY, 1);
+    ASSERT(m->imgArr[4] != NULL);
+
+    for (i = 0; i < xMax * yMax; ++i)
+    {
+        menu_set(m, i + 1);
+        ASSERT(menu_img(m) != NULL);
+        ASSERT(menu_img(m) == m->imgArr[i]);
+    }
+
+    m = menu_destroy(m);
+    ASSERT(m == NULL);
+
+    // missing files are still detected
+    m = menu_creat_cfg(xMax, 3, fn, &cfg);
+    ASSERT(m == NULL);
+
+    return err;
+}
+
+static void removeDir(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    char path[PATH_MAX];
+
+    while ((d != NULL) && ((e = readdir(d)) != NULL))
+    {
+        if (e->d_name[0] == '.') { continue; }
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+    }
+    if (d != NULL) { closedir(d); }
+    rmdir(dir);
+}
+
+/* change every cache file in dir, a value at off or the length if val is 0 */
+static void patchCacheFiles(const char *dir, off_t off, uint32_t val)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    char path[PATH_MAX];
+    int fd;
+
+    while ((d != NULL) && ((e = readdir(d)) != NULL))
+    {
+        if (e->d_name[0] == '.') { continue; }
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        fd = open(path, O_WRONLY);
+        if (fd < 0) { continue; }
+        if (val == 0) { ftruncate(fd, off); }
+        else { pwrite(fd, &val, sizeof(val), off); }
+        close(fd);
+    }
+    if (d != NULL) { closedir(d); }
+}
+
+static void initTestGfx(gfxstate *gfx)
+{
+    memset(gfx, 0, sizeof(*gfx));
+    gfx->hdisplay = 320;    // smaller than the images, only visible part is converted
+    gfx->vdisplay = 240;
+    gfx->stride = 320 * 4;
+    gfx->bits_per_pixel = 32;
+    gfx->rlen = gfx->glen = gfx->blen = 8;
+    gfx->roff = 16;
+    gfx->goff = 8;
+    gfx->boff = 0;
+}
+
+int test_menu_native()
+{
+    int err = 0;
+    menu *m, *mn;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char fn[] = "menu_%x_%y.png";
+    int i, x, y;
+
+    initTestGfx(&gfx);
+    shadow_init(&gfx);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+    m = menu_creat(3, 2, fn);
+    mn = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    ASSERT(mn != NULL);
+    for (i = 0; (m != NULL) && (mn != NULL) && (i < 6); ++i)
+    {
+        ASSERT(mn->imgArr[i] == NULL);
+        ASSERT(mn->nativeArr[i] != NULL);
+        ASSERT_INTEQ(mn->nativeArr[i]->width, 320);
+        ASSERT_INTEQ(mn->nativeArr[i]->height, 240);
+        ASSERT_INTEQ(mn->nativeArr[i]->stride, gfx.stride);
+        for (y = 0; y < 240; y += 17)
+        {
+            uint8_t  *rgb = ida_image_scanline(m->imgArr[i], y);
+            uint32_t *pix = (uint32_t *)(mn->nativeArr[i]->data + y * mn->nativeArr[i]->stride);
+            for (x = 0; x < 320; x += 13)
+            {
+                uint32_t exp = (rgb[3*x] << 16) | (rgb[3*x+1] << 8) | rgb[3*x+2];
+                ASSERT_EX(pix[x] == exp, fprintf(stderr, "\t%d/%d: %x != %x\n", x, y, pix[x], exp); break);
+            }
+        }
+    }
+    ASSERT(menu_native(mn) == mn->nativeArr[0]);
+    ASSERT(menu_img(mn) == NULL);
+
+    mn = menu_destroy(mn);
+    m = menu_destroy(m);
+
+    shadow_fini();
+
+    return err;
+}
+
+int test_simd_pack()
+{
+    int err = 0;
+    static const struct {
+        int bpp, rlen, roff, glen, goff, blen, boff, tlen, toff;
+    } fmt[] = {
+        { 16, 5, 11, 6, 5, 5,  0, 0,  0 },  // RGB565
+        { 15, 5, 10, 5, 5, 5,  0, 0,  0 },  // RGB555
+        { 24, 8, 16, 8, 8, 8,  0, 0,  0 },  // BGR888
+        { 32, 8, 16, 8, 8, 8,  0, 0,  0 },  // XRGB8888
+        { 32, 8, 16, 8, 8, 8,  0, 8, 24 },  // ARGB8888
+        { 32, 8,  0, 8, 8, 8, 16, 0,  0 },  // XBGR8888
+    };
+    static const unsigned int widths[] = { 1, 5, 6, 7, 8, 9, 15, 16, 17, 31, 33, 317 };
+    const unsigned int w = 317, h = 7;
+    enum simd_level max = simd_detect();
+    enum simd_level level;
+    struct ida_image *img;
+    struct gfx_image *ref, *vec;
+    gfxstate gfx;
+    uint8_t *rgb;
+    unsigned int f, i, y;
+
+    // odd width, every line starts unaligned
+    rgb = malloc(((w * 3 + 3) & ~3) * h + 1);
+    ASSERT(rgb != NULL);
+    if (rgb == NULL) { return err; }
+    srand(42);
+    for (i = 0; i < ((w * 3 + 3) & ~3) * h + 1; ++i)
+        rgb[i] = rand();
+    img = map_image(w, h, (w * 3 + 3) & ~3, rgb + 1);
+    ASSERT(img != NULL);
+
+    for (f = 0; (img != NULL) && (f < sizeof(fmt) / sizeof(fmt[0])); ++f)
+    {
+        memset(&gfx, 0, sizeof(gfx));
+        gfx.hdisplay = w;
+        gfx.vdisplay = h;
+        gfx.bits_per_pixel = fmt[f].bpp;
+        gfx.stride = (w * ((fmt[f].bpp + 7) / 8) + 3) & ~3;
+        gfx.rlen = fmt[f].rlen; gfx.roff = fmt[f].roff;
+        gfx.glen = fmt[f].glen; gfx.goff = fmt[f].goff;
+        gfx.blen = fmt[f].blen; gfx.boff = fmt[f].boff;
+        gfx.tlen = fmt[f].tlen; gfx.toff = fmt[f].toff;
+        shadow_init(&gfx);
+
+        for (i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i)
+        {
+            gfx.hdisplay = widths[i];
+            simd_init(&gfx, SIMD_NONE);
+            ref = shadow_convert_image(&gfx, img);
+            ASSERT(ref != NULL);
+            for (level = SIMD_SSSE3; (ref != NULL) && (level <= max); ++level)
+            {
+                if (simd_init(&gfx, level) != level)
+                    continue;
+                vec = shadow_convert_image(&gfx, img);
+                ASSERT(vec != NULL);
+                for (y = 0; (vec != NULL) && (y < h); ++y)
+                {
+                    ASSERT_EX(memcmp(ref->data + y * ref->stride, vec->data + y * vec->stride,
+                                     widths[i] * ((fmt[f].bpp + 7) / 8)) == 0,
+                              fprintf(stderr, "\tbpp %d, level %d, width %u, line %u\n",
+                                      fmt[f].bpp, level, widths[i], y); break);
+                }
+                gfx_image_free(vec);
+            }
+            gfx_image_free(ref);
+        }
+
+        shadow_fini();
+    }
+
+    free_image(img);
+    free(rgb);
+
+    return err;
+}
+
+static gfxstate *flipGfx;
+static int flipCnt;
+
+static void testFlip(bool second)
+{
+    uint8_t *back = flipGfx->mem;
+    flipGfx->mem  = flipGfx->mem2;
+    flipGfx->mem2 = back;
+    ++flipCnt;
+}
+
+int test_shadow_double()
+{
+    int err = 0;
+    gfxstate gfx;
+    uint8_t page[2][16 * 4 * 8];
+    uint8_t zero[16 * 4 * 8];
+
+    memset(&gfx, 0, sizeof(gfx));
+    gfx.hdisplay = 16;
+    gfx.vdisplay = 8;
+    gfx.stride = 16 * 4;
+    gfx.bits_per_pixel = 32;
+    gfx.rlen = gfx.glen = gfx.blen = 8;
+    gfx.roff = 16;
+    gfx.goff = 8;
+    gfx.mem  = page[0];
+    gfx.mem2 = page[1];
+    gfx.flush_display = testFlip;
+    flipGfx = &gfx;
+    flipCnt = 0;
+    memset(page, 0xaa, sizeof(page));
+    memset(zero, 0, sizeof(zero));
+
+    shadow_init(&gfx);  // clears the shadow, all lines dirty
+    shadow_render(&gfx);
+    ASSERT_INTEQ(flipCnt, 1);
+    ASSERT(memcmp(page[0], zero, sizeof(zero)) == 0);
+    ASSERT(gfx.mem == page[1]);
+
+    // nothing new, but the 2nd page still shows old content
+    shadow_render(&gfx);
+    ASSERT_INTEQ(flipCnt, 2);
+    ASSERT(memcmp(page[1], zero, sizeof(zero)) == 0);
+
+    // both pages up to date, nothing to render
+    memset(page[0], 0x55, sizeof(page[0]));
+    shadow_render(&gfx);
+    ASSERT(page[0][0] == 0x55);
+
+    shadow_fini();
+
+    return err;
+}
+
+int test_shadow_spans()
+{
+    int err = 0;
+    gfxstate gfx;
+    uint32_t mem[32 * 8];
+    uint8_t rgb[16 * 4 * 3];
+    struct ida_image *img;
+
+    memset(&gfx, 0, sizeof(gfx));
+    gfx.hdisplay = 32;
+    gfx.vdisplay = 8;
+    gfx.stride = 32 * 4;
+    gfx.bits_per_pixel = 32;
+    gfx.rlen = gfx.glen = gfx.blen = 8;
+    gfx.roff = 16;
+    gfx.goff = 8;
+    gfx.mem = (uint8_t *)mem;
+    memset(mem, 0xaa, sizeof(mem));
+    memset(rgb, 0xff, sizeof(rgb));
+    img = map_image(16, 4, 16 * 3, rgb);
+    ASSERT(img != NULL);
+    if (img == NULL) { return err; }
+
+    // first render covers the whole screen, image centered at 8,2
+    shadow_init(&gfx);
+    shadow_draw_image(&gfx, img, 0, 0, 0, 7, 100);
+    shadow_render(&gfx);
+    ASSERT((mem[0] & 0xffffff) == 0);
+    ASSERT(mem[3 * 32 + 7] == 0);
+    ASSERT(mem[3 * 32 + 8] == 0xffffff);
+    ASSERT(mem[5 * 32 + 23] == 0xffffff);
+    ASSERT(mem[5 * 32 + 24] == 0);
+    ASSERT(mem[7 * 32 + 31] == 0);
+
+    // redraw only touches the image, black borders are not rewritten
+    mem[0] = mem[3 * 32 + 7] = mem[5 * 32 + 24] = 0x123456;
+    mem[3 * 32 + 8] = mem[5 * 32 + 23] = 0x123456;
+    shadow_draw_image(&gfx, img, 0, 0, 0, 7, 100);
+    shadow_render(&gfx);
+    ASSERT(mem[0] == 0x123456);
+    ASSERT(mem[3 * 32 + 7] == 0x123456);
+    ASSERT(mem[5 * 32 + 24] == 0x123456);
+    ASSERT(mem[3 * 32 + 8] == 0xffffff);
+    ASSERT(mem[5 * 32 + 23] == 0xffffff);
+
+    // darkify changes the image area only
+    shadow_darkify(0, 31, 0, 7, 50);
+    shadow_render(&gfx);
+    ASSERT(mem[0] == 0x123456);
+    ASSERT(mem[3 * 32 + 7] == 0x123456);
+    ASSERT_EX((mem[3 * 32 + 8] & 0xff) >= 0x7f && (mem[3 * 32 + 8] & 0xff) <= 0x80,
+              fprintf(stderr, "\t%x\n", mem[3 * 32 + 8]));
+
+    // 50 % of the image added to the darkified one
+    shadow_draw_image(&gfx, img, 0, 0, 0, 7, 50);
+    shadow_render(&gfx);
+    ASSERT_EX((mem[5 * 32 + 23] & 0xff) >= 0xbe && (mem[5 * 32 + 23] & 0xff) <= 0xc0,
+              fprintf(stderr, "\t%x\n", mem[5 * 32 + 23]));
+    ASSERT(mem[5 * 32 + 24] == 0x123456);
+
+    // clearing resets the image area only
+    shadow_clear();
+    shadow_render(&gfx);
+    ASSERT(mem[3 * 32 + 8] == 0);
+    ASSERT(mem[3 * 32 + 7] == 0x123456);
+
+    shadow_fini();
+    free_image(img);
+
+    return err;
+}
+
+static int waitCnt;
+
+static int testWait(int timeout)
+{
+    usleep(timeout * 1000);
+    return --waitCnt == 0;
+}
+
+int test_transition()
+{
+    int err = 0;
+    gfxstate gfx, gfx24;
+    uint32_t mem[32 * 8];
+    uint8_t black[16 * 4 * 3], white[16 * 4 * 3];
+    struct ida_image *img[2];
+    struct gfx_image *native[2];
+    transition_tile from, to, mixed;
+    transition_perf perf;
+    transition_mode mode;
+    int i;
+
+    ASSERT(transition_parse("fade", &mode) == 0 && mode == transition_fade);
+    ASSERT(transition_parse("slide", &mode) == 0 && mode == transition_slide);
+    ASSERT(transition_parse("none", &mode) == 0 && mode == transition_none);
+    ASSERT(transition_parse("wipe", &mode) == -1);
+
+    memset(&gfx, 0, sizeof(gfx));
+    gfx.hdisplay = 32;
+    gfx.vdisplay = 8;
+    gfx.stride = 32 * 4;
+    gfx.bits_per_pixel = 32;
+    gfx.rlen = gfx.glen = gfx.blen = 8;
+    gfx.roff = 16;
+    gfx.goff = 8;
+    gfx.mem = (uint8_t *)mem;
+    memset(black, 0, sizeof(black));
+    memset(white, 0xff, sizeof(white));
+    img[0] = map_image(16, 4, 16 * 3, black);
+    img[1] = map_image(16, 4, 16 * 3, white);
+    ASSERT(img[0] != NULL && img[1] != NULL);
+    if (img[0] == NULL || img[1] == NULL) { return err; }
+
+    shadow_init(&gfx);
+    for (i = 0; i < 2; ++i)
+    {
+        native[i] = shadow_convert_image(&gfx, img[i]);
+        ASSERT(native[i] != NULL);
+    }
+
+    // RGB tiles
+    memset(&from, 0, sizeof(from));
+    memset(&to, 0, sizeof(to));
+    from.img = img[0];
+    to.img = img[1];
+    waitCnt = -1;
+    ASSERT(transition_run(&gfx, transition_fade, 50, &from, &to, 0, 0, testWait, &perf) == 0);
+    ASSERT(perf.frames >= 2);
+    ASSERT_EX(perf.frames <= 50 * TRANSITION_FPS / 1000 + 1, fprintf(stderr, "\t%d frames %ld us\n", perf.frames, perf.totalUs));
+    ASSERT(perf.totalUs >= 50000);
+    ASSERT((mem[3 * 32 + 16] & 0xff) > 0x80);     // last frame mostly white
+    ASSERT((mem[0] & 0xffffff) == 0);
+
+    // canceled after the first frame
+    waitCnt = 1;
+    ASSERT(transition_run(&gfx, transition_slide, 1000, &from, &to, 1, 0, testWait, &perf) == 1);
+    ASSERT_INTEQ(perf.frames, 1);
+
+    // native tiles
+    from.img = to.img = NULL;
+    from.native = native[0];
+    to.native = native[1];
+    waitCnt = -1;
+    ASSERT(transition_run(&gfx, transition_fade, 50, &from, &to, 0, 0, testWait, &perf) == 0);
+    ASSERT(perf.frames >= 2);
+    ASSERT((mem[3 * 32 + 16] & 0xff) > 0x80);     // last frame mostly white
+    ASSERT((mem[0] & 0xffffff) == 0);
+    waitCnt = 1;
+    ASSERT(transition_run(&gfx, transition_slide, 1000, &from, &to, 0, 1, testWait, &perf) == 1);
+    ASSERT_INTEQ(perf.frames, 1);
+
+    // not possible
+    memset(&mixed, 0, sizeof(mixed));
+    mixed.img = img[1];
+    ASSERT(transition_run(&gfx, transition_fade, 50, &from, &mixed, 0, 0, testWait, &perf) == -1);
+    ASSERT(transition_run(&gfx, transition_slide, 50, &from, &to, 0, 0, testWait, &perf) == -1);
+    ASSERT(transition_run(&gfx, transition_none, 50, &from, &to, 1, 0, testWait, &perf) == -1);
+    gfx24 = gfx;
+    gfx24.bits_per_pixel = 24;
+    gfx24.stride = 30 * 3;      // 24 bpp lines not 32 bit aligned
+    ASSERT(transition_run(&gfx24, transition_fade, 50, &from, &to, 0, 0, testWait, &perf) == -1);
+    ASSERT_INTEQ(perf.frames, 0);
+
+    shadow_fini();
+    for (i = 0; i < 2; ++i)
+    {
+        gfx_image_free(native[i]);
+        free_image(img[i]);
+    }
+
+    return err;
+}
+
+int test_trace()
+{
+    int err = 0;
+    char fn[] = "/tmp/frabenu_trace_XXXXXX";
+    char line[64];
+    int fd, lines = 0;
+    FILE *fp;
+
+    unsetenv(TRACE_ENV);
+    ASSERT(trace_init(NULL) == 1);
+    trace_mark(trace_input);    // not initialized, ignored
+    ASSERT(trace_percentile(trace_input, 50) == -1);
+
+    fd = mkstemp(fn);
+    ASSERT(fd >= 0);
+    if (fd < 0) { return err; }
+    close(fd);
+    ASSERT(trace_init(fn) == 0);
+
+    trace_mark(trace_menu);     // no sequence yet
+    trace_mark(trace_input);
+    trace_mark(trace_menu);
+    usleep(2000);
+    trace_mark(trace_render);
+    trace_mark(trace_render);   // only the first one counts
+    trace_mark(trace_flip);
+    trace_mark(trace_draw);     // sequence done
+    trace_mark(trace_input);
+    trace_mark(trace_menu);
+
+    ASSERT(trace_percentile(trace_input, 50) == 0);
+    ASSERT(trace_percentile(trace_menu, 99) >= 0);
+    ASSERT(trace_percentile(trace_render, 50) >= 2000);
+    ASSERT(trace_percentile(trace_flip, 50) >= trace_percentile(trace_render, 50));
+    ASSERT(trace_percentile(trace_draw, 50) == -1);
+    trace_stop();
+
+    fp = fopen(fn, "r");
+    ASSERT(fp != NULL);
+    while ((fp != NULL) && (fgets(line, sizeof(line), fp) != NULL))
+    {
+        ++lines;
+    }
+    if (fp != NULL) { fclose(fp); }
+    ASSERT_INTEQ(lines, 1 + 4 + 2);
+    unlink(fn);
+
+    return err;
+}
+
+int test_mem_gfx()
+{
+    int err = 0;
+    char fn[] = "/tmp/frabenu_ppm_XXXXXX";
+    static const uint32_t bpps[] = { 16, 24, 32 };
+    uint8_t rgb[4 * 2 * 3] = { 0xff, 0, 0,  0, 0xff, 0,  0, 0, 0xff,  0xff, 0xff, 0xff,
+                               0, 0, 0,  0xf8, 0xfc, 0xf8,  0x80, 0x40, 0x20,  0x10, 0x20, 0x30 };
+    uint8_t ppm[64];
+    uint32_t w, h, bpp;
+    struct ida_image *img;
+    gfxstate *gfx;
+    int fd, i;
+    FILE *fp;
+
+    ASSERT(mem_parse_mode("640x480", &w, &h, &bpp) == 0);
+    ASSERT(w == 640 && h == 480 && bpp == 32);
+    ASSERT(mem_parse_mode("800x600x16", &w, &h, &bpp) == 0);
+    ASSERT(w == 800 && h == 600 && bpp == 16);
+    ASSERT(mem_parse_mode("800x600x8", &w, &h, &bpp) == -1);
+    ASSERT(mem_parse_mode("800", &w, &h, &bpp) == -1);
+    ASSERT(mem_init(4, 2, 8, NULL) == NULL);
+
+    fd = mkstemp(fn);
+    ASSERT(fd >= 0);
+    if (fd < 0) { return err; }
+    close(fd);
+    img = map_image(4, 2, 4 * 3, rgb);
+
+    for (i = 0; i < 3; ++i)
+    {
+        gfx = mem_init(4, 2, bpps[i], fn);
+        ASSERT(gfx != NULL);
+        if (gfx == NULL) { continue; }
+        shadow_init(gfx);
+        shadow_draw_image(gfx, img, 0, 0, 0, gfx->vdisplay-1, 100);
+        shadow_render(gfx);
+        shadow_fini();
+        gfx->cleanup_display();    // writes the dump
+        free(gfx);
+
+        fp = fopen(fn, "rb");
+        ASSERT(fp != NULL);
+        if (fp == NULL) { continue; }
+        ASSERT(fread(ppm, 1, 11 + sizeof(rgb), fp) == 11 + sizeof(rgb));
+        fclose(fp);
+        ASSERT(memcmp(ppm, "P6\n4 2\n255\n", 11) == 0);
+        if (bpps[i] == 16)
+        {
+            // RGB565 is only lossless for full and zero channels
+            ASSERT(memcmp(ppm + 11, rgb, 5 * 3) == 0);
+        }
+        else
+        {
+            ASSERT(memcmp(ppm + 11, rgb, sizeof(rgb)) == 0);
+        }
+    }
+
+    free_image(img);
+    unlink(fn);
+
+    return err;
+}
+
+int test_scale_image()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char fn[] = "menu_%x_%y.png";
+    uint8_t rgb[16 * 8 * 3];
+    struct ida_image *img, *scaled;
+    uint8_t *line;
+    int i, x, y;
+
+    for (i = 0; i < sizeof(rgb); i += 3)
+    {
+        rgb[i + 0] = 10; rgb[i + 1] = 20; rgb[i + 2] = 30;
+    }
+    img = map_image(16, 8, 16 * 3, rgb);
+    ASSERT(img != NULL);
+    if (img == NULL) { return err; }
+
+    ASSERT(scale_image_to(img, 32, 8, 0) == img);   // already fits
+    scaled = scale_image_to(img, 16, 16, 1);         // needs scaling to cover
+    ASSERT(scaled != NULL && scaled != img);
+    if ((scaled != NULL) && (scaled != img))
+    {
+        ASSERT_INTEQ(scaled->i.width, 16);
+        ASSERT_INTEQ(scaled->i.height, 16);
+        free_image(scaled);
+    }
+
+    scaled = scale_image_to(img, 4, 4, 0);
+    ASSERT(scaled != NULL && scaled != img);
+    if ((scaled != NULL) && (scaled != img))
+    {
+        ASSERT_INTEQ(scaled->i.width, 4);
+        ASSERT_INTEQ(scaled->i.height, 2);
+        for (y = 0; y < 2; ++y)
+        {
+            line = ida_image_scanline(scaled, y);
+            for (x = 0; x < 4 * 3; x += 3)
+            {
+                ASSERT((line[x] == 10) && (line[x + 1] == 20) && (line[x + 2] == 30));
+            }
+        }
+        free_image(scaled);
+    }
+
+    scaled = scale_image_to(img, 4, 4, 1);
+    ASSERT(scaled != NULL && scaled != img);
+    if ((scaled != NULL) && (scaled != img))
+    {
+        ASSERT_INTEQ(scaled->i.width, 4);
+        ASSERT_INTEQ(scaled->i.height, 4);
+        free_image(scaled);
+    }
+    free_image(img);
+
+    // 640x480 images on a 200x240 display
+    initTestGfx(&gfx);
+    gfx.hdisplay = 200;
+    gfx.stride = 200 * 4;
+    shadow_init(&gfx);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+    cfg.scale = menu_scale_fit;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    for (i = 0; (m != NULL) && (i < 6); ++i)
+    {
+        ASSERT(m->imgArr[i] == NULL);
+        ASSERT(m->nativeArr[i] != NULL);
+        if (m->nativeArr[i] == NULL) { continue; }
+        ASSERT_INTEQ(m->nativeArr[i]->width, 200);
+        ASSERT_INTEQ(m->nativeArr[i]->height, 150);
+    }
+    m = menu_destroy(m);
+
+    cfg.scale = menu_scale_fill;
+    cfg.lazy = 1;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    for (i = 0; (m != NULL) && (i < 6); ++i)
+    {
+        struct gfx_image *gimg = menu_native_at(m, i);
+        ASSERT(gimg != NULL);
+        if (gimg == NULL) { continue; }
+        ASSERT_INTEQ(gimg->width, 200);
+        ASSERT_INTEQ(gimg->height, 240);
+    }
+    m = menu_destroy(m);
+
+    shadow_fini();
+
+    return err;
+}
+
+int test_menu_budget()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char fn[] = "menu_%x_%y.png";
+    struct gfx_image *gimg;
+
+    initTestGfx(&gfx);
+    shadow_init(&gfx);
+
+    // smaller than one tile, only shown and neighbouring tiles are kept
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+    cfg.budget = 1;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    if (m == NULL) { shadow_fini(); return err; }
+
+    ASSERT(menu_native(m) != NULL);
+    ASSERT(menu_native_at(m, 3) != NULL);
+    menu_task(m, menu_scroll_mode_1, input_right);
+    menu_task(m, menu_scroll_mode_1, input_right);
+    ASSERT_INTEQ(menu_get(m), 2);
+    ASSERT(menu_native(m) != NULL);
+    ASSERT(menu_native_at(m, 5) != NULL);   // loading it evicts all others not needed
+
+    ASSERT(m->nativeArr[0] == NULL);
+    ASSERT(m->nativeArr[3] == NULL);
+    ASSERT(m->nativeArr[4] == NULL);
+    ASSERT(m->nativeArr[2] != NULL);
+    ASSERT(m->nativeArr[5] != NULL);
+
+    // evicted tiles are loaded again on demand
+    gimg = menu_native_at(m, 0);
+    ASSERT(gimg != NULL);
+    if (gimg != NULL)
+    {
+        ASSERT_INTEQ(gimg->width, 320);
+        ASSERT_INTEQ(gimg->height, 240);
+    }
+    ASSERT(m->nativeArr[5] != NULL);        // still handed out
+
+    m = menu_destroy(m);
+    shadow_fini();
+
+    return err;
+}
+
+/* wait until a worker loaded a tile in background */
+static int waitLoaded(menu *m, int idx)
+{
+    int i;
+
+    for (i = 0; i < 200; ++i)
+    {
+        if (menu_loaded(m, idx) == 1) { return 1; }
+        usleep(10000);
+    }
+    return 0;
+}
+
+int test_menu_prefetch()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char fn[] = "menu_%x_%y.png";
+
+    initTestGfx(&gfx);
+    shadow_init(&gfx);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+    cfg.budget = 1;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    if (m == NULL) { shadow_fini(); return err; }
+
+    // mode 2 rolls through x and y, left of 0 is 2, up and down is 3
+    menu_task(m, menu_scroll_mode_2, input_none);
+    ASSERT(waitLoaded(m, 1));
+    ASSERT(waitLoaded(m, 2));
+    ASSERT(waitLoaded(m, 3));
+    ASSERT_INTEQ(menu_loaded(m, 4), 0);
+    ASSERT_INTEQ(menu_loaded(m, 5), 0);
+
+    // mode 4 rolls through all, 0 -> 5, next are 4, 0 and 2
+    menu_task(m, menu_scroll_mode_4, input_left);
+    ASSERT_INTEQ(menu_get(m), 5);
+    ASSERT(waitLoaded(m, 4));
+    ASSERT(waitLoaded(m, 5));
+    ASSERT_INTEQ(menu_loaded(m, 0), 1);
+    ASSERT_INTEQ(menu_loaded(m, 2), 1);
+    ASSERT_INTEQ(menu_loaded(m, 1), 0);
+    ASSERT_INTEQ(menu_loaded(m, 3), 0);
+
+    m = menu_destroy(m);
+    shadow_fini();
+
+    return err;
+}
+
+int test_menu_lazy_failed()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char dir[] = "/tmp/frabenu_XXXXXX";
+    char cwd[PATH_MAX];
+    char src[PATH_MAX + 32];
+    char dst[PATH_MAX];
+    char fn[PATH_MAX];
+    int x, y, fd;
+
+    ASSERT(getcwd(cwd, sizeof(cwd)) != NULL);
+    ASSERT(mkdtemp(dir) != NULL);
+    for (y = 1; y <= 2; ++y)
+    {
+        for (x = 1; x <= 3; ++x)
+        {
+            snprintf(src, sizeof(src), "%s/menu_%d_%d.png", cwd, x, y);
+            snprintf(dst, sizeof(dst), "%s/menu_%d_%d.png", dir, x, y);
+            ASSERT_INTEQ(symlink(src, dst), 0);
+        }
+    }
+    // tile 1 is readable but does not decode
+    snprintf(dst, sizeof(dst), "%s/menu_2_1.png", dir);
+    unlink(dst);
+    fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    ASSERT(write(fd, "no png", 6) == 6);
+    close(fd);
+    snprintf(fn, sizeof(fn), "%s/menu_%%x_%%y.png", dir);
+
+    initTestGfx(&gfx);
+    shadow_init(&gfx);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+    cfg.budget = 1;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    if (m == NULL) { shadow_fini(); removeDir(dir); return err; }
+
+    // the broken tile fails on its own
+    ASSERT(menu_native_at(m, 1) == NULL);
+    ASSERT_INTEQ(menu_loaded(m, 1), 0);
+
+    // workers still load the tiles wanted later, 0 -> 5, next are 4, 0 and 2
+    menu_task(m, menu_scroll_mode_4, input_left);
+    ASSERT_INTEQ(menu_get(m), 5);
+    ASSERT(waitLoaded(m, 4));
+    ASSERT(waitLoaded(m, 5));
+    ASSERT(waitLoaded(m, 2));
+    ASSERT(menu_native(m) != NULL);
+
+    m = menu_destroy(m);
+    shadow_fini();
+    removeDir(dir);
+
+    return err;
+}
+
+/* vt switch signals must reach the main thread, not a busy worker */
+int test_menu_signals()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    DIR *d;
+    struct dirent *e;
+    char path[PATH_MAX];
+    char line[128];
+    unsigned long long blocked;
+    FILE *fp;
+    int workers = 0;
+    char fn[] = "menu_%x_%y.png";
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.budget = 1;
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    if (m == NULL) { return err; }
+    // wait for the worker to run, a new thread blocks all signals at first
+    menu_task(m, menu_scroll_mode_2, input_none);
+    ASSERT(waitLoaded(m, 1));
+
+    d = opendir("/proc/self/task");
+    ASSERT(d != NULL);
+    while ((d != NULL) && ((e = readdir(d)) != NULL))
+    {
+        if ((e->d_name[0] == '.') || (atoi(e->d_name) == getpid())) { continue; }
+        snprintf(path, sizeof(path), "/proc/self/task/%s/status", e->d_name);
+        fp = fopen(path, "r");
+        if (fp == NULL) { continue; }
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (sscanf(line, "SigBlk: %llx", &blocked) == 1)
+            {
+                ASSERT(blocked & (1ULL << (SIGUSR1 - 1)));
+                ASSERT(blocked & (1ULL << (SIGUSR2 - 1)));
+                ++workers;
+            }
+        }
+        fclose(fp);
+    }
+    if (d != NULL) { closedir(d); }
+    ASSERT(workers > 0);
+
+    m = menu_destroy(m);
+
+    return err;
+}
+
+int test_key2event()
+{
+    int err = 0;
+    static int keysA[]   = {KEY_A, KEY_ENTER, 0};
+    static int keysB[]   = {KEY_B, KEY_ENTER, BTN_THUMBR, 0};
+    static int keysMax[] = {KEY_MAX, 0};
+    static event_map map1 = {NULL};
+    static event_map map2 = {NULL};
+
+    map1[input_left]   = keysA;
+    map1[input_select] = keysB;
+    map1[input_abort]  = keysMax;
+    map2[input_up]     = keysB;
+
+    key2event_init(map1);
+    ASSERT_INTEQ(key2event(map1, KEY_A), input_left);
+    ASSERT_INTEQ(key2event(map1, KEY_B), input_select);
+    ASSERT_INTEQ(key2event(map1, KEY_ENTER), input_left);   // first event wins
+    ASSERT_INTEQ(key2event(map1, BTN_THUMBR), input_select);
+    ASSERT_INTEQ(key2event(map1, KEY_MAX), input_abort);
+    ASSERT_INTEQ(key2event(map1, KEY_C), input_none);
+    ASSERT_INTEQ(key2event(map1, KEY_RESERVED), input_none);
+    ASSERT_INTEQ(key2event(map1, -1), input_none);
+    ASSERT_INTEQ(key2event(map1, KEY_CNT), input_none);
+
+    // every map has its own table
+    ASSERT_INTEQ(key2event(map2, KEY_ENTER), input_up);
+    ASSERT_INTEQ(key2event(map2, KEY_A), input_none);
+    ASSERT_INTEQ(key2event(map1, KEY_ENTER), input_left);
+
+    return err;
+}
+
+/* feed stdin of the input drivers through a pipe */
+static int inputPipe(int *stdinSave)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) { return -1; }
+    *stdinSave = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    return fds[1];
+}
+
+static void inputPipeClose(int fd, int stdinSave)
+{
+    close(fd);
+    dup2(stdinSave, STDIN_FILENO);
+    close(stdinSave);
+}
+
+/* collect events from some wakeups */
+static int inputCollect(input_event *out, int max, int wakeups)
+{
+    int cnt = 0, n;
+
+    while ((wakeups-- > 0) && (cnt < max))
+    {
+        n = input_get_batch(out + cnt, max - cnt);
+        if (n < 0) { break; }
+        cnt += n;
+    }
+    return cnt;
+}
+
+int test_input_epoll()
+{
+    int err = 0;
+    input_event ev[8];
+    struct timespec start;
+    int fd, stdinSave;
+    long us;
+
+    // not initialized: an error, not an empty batch
+    ASSERT_INTEQ(input_get_batch(ev, 8), -1);
+
+    setenv("ESCDELAY", "50", 1);
+    fd = inputPipe(&stdinSave);
+    ASSERT(fd >= 0);
+    if (fd < 0) { return err; }
+    ASSERT_INTEQ(input_init(), 0);
+
+    // CSI sequence and a plain key
+    ASSERT(write(fd, "\033[Cq", 4) == 4);
+    ASSERT_INTEQ(inputCollect(ev, 2, 10), 2);
+    ASSERT_INTEQ(ev[0], input_right);
+    ASSERT_INTEQ(ev[1], input_abort);
+
+    // a burst is read at once, nothing after abort
+    ASSERT(write(fd, "\033[C\033[C\033[Bq\033[D", 14) == 14);
+    ASSERT_INTEQ(input_get_batch(ev, 8), 4);      // decoded in the same wakeup
+    ASSERT_INTEQ(ev[0], input_right);
+    ASSERT_INTEQ(ev[1], input_right);
+    ASSERT_INTEQ(ev[2], input_down);
+    ASSERT_INTEQ(ev[3], input_abort);
+    ASSERT_INTEQ(input_pending(0), 0);
+
+    // keys not fitting stay queued and are returned without blocking
+    ASSERT(write(fd, "\033[C\033[B", 6) == 6);
+    ASSERT_INTEQ(input_get_batch(ev, 1), 1);
+    ASSERT_INTEQ(ev[0], input_right);
+    ASSERT_INTEQ(input_pending(0), 1);
+    ASSERT_INTEQ(input_get_batch(ev, 8), 1);
+    ASSERT_INTEQ(ev[0], input_down);
+    ASSERT_INTEQ(input_pending(0), 0);
+
+    // single ESC needs the timer
+    getCurClock(&start);
+    ASSERT(write(fd, "\033", 1) == 1);
+    ASSERT_INTEQ(inputCollect(ev, 1, 10), 1);
+    ASSERT_INTEQ(ev[0], input_abort);
+    us = getElapsedUs(&start);
+    ASSERT((us >= 45000) && (us < 1000000));
+
+    // a pending timer is no input
+    ASSERT(write(fd, "\033", 1) == 1);
+    ASSERT_INTEQ(input_get_batch(ev, 8), 0);      // reads the ESC only
+    ASSERT_INTEQ(input_get_batch(ev, 8), 0);      // timer, ESC queued on next call
+    ASSERT_INTEQ(input_get_batch(ev, 8), 1);
+    ASSERT_INTEQ(input_pending(100), 0);
+
+    input_stop();
+    inputPipeClose(fd, stdinSave);
+    unsetenv("ESCDELAY");
+
+    return err;
+}
+
+/* write one evdev event to a fake device */
+static int evdevWrite(int fd, uint16_t type, uint16_t code, int32_t value)
+{
+    struct input_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    return write(fd, &ev, sizeof(ev)) == sizeof(ev);
+}
+
+int test_input_evdev()
+{
+    int err = 0;
+    input_event ev[16];
+    char fn[] = "/tmp/frabenu_test_XXXXXX";
+    char dev[sizeof(fn) + 4];
+    int fd, kbdFd, stdinSave;
+
+    kbdFd = inputPipe(&stdinSave);
+    ASSERT(kbdFd >= 0);
+    if (kbdFd < 0) { return err; }
+
+    // a fifo as device: no grab, no axes, but the same events
+    ASSERT(mkdtemp(fn) != NULL);
+    snprintf(dev, sizeof(dev), "%s/ev", fn);
+    ASSERT_INTEQ(mkfifo(dev, 0600), 0);
+    fd = open(dev, O_RDWR);
+    ASSERT(fd >= 0);
+    if (fd < 0) { return err; }
+    ASSERT_INTEQ(evdev_cfgAddDev(dev), 0);
+    ASSERT_INTEQ(input_init(), 0);
+
+    // ESC without any delay
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_ESC, 1));
+    ASSERT(evdevWrite(fd, EV_SYN, SYN_REPORT, 0));
+    ASSERT_INTEQ(input_get_batch(ev, 16), 1);
+    ASSERT_INTEQ(ev[0], input_abort);
+
+    // release and unmapped keys are ignored, auto repeat for moves only
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_ESC, 0));
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_RIGHT, 1));
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_RIGHT, 2));
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_RIGHT, 0));
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_A, 1));
+    ASSERT(evdevWrite(fd, EV_KEY, KEY_ENTER, 2));
+    ASSERT(evdevWrite(fd, EV_KEY, BTN_DPAD_DOWN, 1));
+    ASSERT(evdevWrite(fd, EV_KEY, BTN_SOUTH, 1));
+    ASSERT(evdevWrite(fd, EV_SYN, SYN_REPORT, 0));
+    ASSERT_INTEQ(input_get_batch(ev, 16), 4);
+    ASSERT_INTEQ(ev[0], input_right);
+    ASSERT_INTEQ(ev[1], input_right);
+    ASSERT_INTEQ(ev[2], input_down);
+    ASSERT_INTEQ(ev[3], input_select);
+    ASSERT_INTEQ(input_pending(0), 0);
+
+    // a lone release is no pending input
+    ASSERT(evdevWrite(fd, EV_KEY, BTN_DPAD_DOWN, 0));
+    ASSERT(evdevWrite(fd, EV_SYN, SYN_REPORT, 0));
+    ASSERT_INTEQ(input_pending(0), 0);
+    ASSERT_INTEQ(input_pending(20), 0);
+
+    input_stop();
+    inputPipeClose(kbdFd, stdinSave);
+    close(fd);
+    unlink(dev);
+    rmdir(fn);
+
+    return err;
+}
+
+static int transitionFd = -1;
+static const char *transitionData;
+static size_t transitionLen;
+
+/* input_pending() as transition wait, some data written after the first frame */
+static int transitionWait(int timeout)
+{
+    if (transitionData != NULL)
+    {
+        if (write(transitionFd, transitionData, transitionLen) != (ssize_t)transitionLen) { return 1; }
+        transitionData = NULL;
+    }
+    return input_pending(timeout);
+}
+
+int test_transition_input()
+{
+    int err = 0;
+    gfxstate gfx;
+    uint32_t mem[32 * 8];
+    uint8_t black[16 * 4 * 3], white[16 * 4 * 3];
+    transition_tile from, to;
+    transition_perf perf;
+    struct input_event rel[4];
+    input_event ev[8];
+    char fn[] = "/tmp/frabenu_test_XXXXXX";
+    char dev[sizeof(fn) + 4];
+    int devFd, kbdFd, stdinSave;
+
+    memset(&gfx, 0, sizeof(gfx));
+    gfx.hdisplay = 32;
+    gfx.vdisplay = 8;
+    gfx.stride = 32 * 4;
+    gfx.bits_per_pixel = 32;
+    gfx.rlen = gfx.glen = gfx.blen = 8;
+    gfx.roff = 16;
+    gfx.goff = 8;
+    gfx.mem = (uint8_t *)mem;
+    memset(black, 0, sizeof(black));
+    memset(white, 0xff, sizeof(white));
+    memset(&from, 0, sizeof(from));
+    memset(&to, 0, sizeof(to));
+    from.img = map_image(16, 4, 16 * 3, black);
+    to.img = map_image(16, 4, 16 * 3, white);
+    ASSERT(from.img != NULL && to.img != NULL);
+    if (from.img == NULL || to.img == NULL) { return err; }
+    shadow_init(&gfx);
+
+    // a fifo as event device, see test_input_evdev()
+    kbdFd = inputPipe(&stdinSave);
+    ASSERT(kbdFd >= 0);
+    ASSERT(mkdtemp(fn) != NULL);
+    snprintf(dev, sizeof(dev), "%s/ev", fn);
+    ASSERT_INTEQ(mkfifo(dev, 0600), 0);
+    devFd = open(dev, O_RDWR);
+    ASSERT(devFd >= 0);
+    ASSERT_INTEQ(evdev_cfgAddDev(dev), 0);
+    ASSERT_INTEQ(input_init(), 0);
+
+    // release, scan code, unknown axis and report end do not cancel
+    memset(rel, 0, sizeof(rel));
+    rel[0].type = EV_MSC;
+    rel[0].code = MSC_SCAN;
+    rel[1].type = EV_KEY;
+    rel[1].code = BTN_SOUTH;
+    rel[2].type = EV_ABS;
+    rel[2].code = ABS_HAT0X;
+    rel[3].type = EV_SYN;
+    rel[3].code = SYN_REPORT;
+    transitionFd = devFd;
+    transitionData = (const char *)rel;
+    transitionLen = sizeof(rel);
+    ASSERT_INTEQ(transition_run(&gfx, transition_fade, 60, &from, &to, 0, 0, transitionWait, &perf), 0);
+    ASSERT(perf.totalUs >= 60000);
+    ASSERT_INTEQ(input_pending(0), 0);
+
+    // a key cancels and is not lost
+    transitionFd = kbdFd;
+    transitionData = "q";
+    transitionLen = 1;
+    ASSERT_INTEQ(transition_run(&gfx, transition_fade, 1000, &from, &to, 0, 0, transitionWait, &perf), 1);
+    ASSERT(perf.totalUs < 500000);
+    ASSERT_INTEQ(input_get_batch(ev, 8), 1);
+    ASSERT_INTEQ(ev[0], input_abort);
+
+    input_stop();
+    inputPipeClose(kbdFd, stdinSave);
+    close(devFd);
+    unlink(dev);
+    rmdir(fn);
+    shadow_fini();
+    free_image(from.img);
+    free_image(to.img);
+
+    return err;
+}
+
+int test_menu_cache()
+{
+    int err = 0;
+    menu *m;
+    menu_cfg cfg;
+    gfxstate gfx;
+    char dir[] = "/tmp/frabenu_test_XXXXXX";
+    char fn[] = "menu_%x_%y.png";
+    struct gfx_image *gimg;
+    int i;
+
+    initTestGfx(&gfx);
+    shadow_init(&gfx);
+
+    ASSERT(mkdtemp(dir) != NULL);
+    ASSERT_INTEQ(cache_init(dir, &gfx, menu_scale_none), 0);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.gfx = &gfx;
+
+    // 1st run decodes and fills the cache
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    for (i = 0; (m != NULL) && (i < 6); ++i)
+    {
+        ASSERT(m->nativeArr[i] != NULL);
+        ASSERT(m->nativeArr[i]->map == NULL);
+    }
+    m = menu_destroy(m);
+
+    // 2nd run uses the cache only
+    m = menu_creat_cfg(3, 2, fn, &cfg);
+    ASSERT(m != NULL);
+    for (i = 0; (m != NULL) && (i < 6); ++i)
+    {
+        ASSERT(m->imgArr[i] == NULL);
+        ASSERT(m->nativeArr[i] != NULL);
+        ASSERT(m->nativeArr[i]->map != NULL);
+        ASSERT_INTEQ(m->nativeArr[i]->width, 320);
+        ASSERT_INTEQ(m->nativeArr[i]->height, 240);
+    }
+    m = menu_destroy(m);
+
+    // broken files are not used: larger than display, short lines, truncated
+    patchCacheFiles(dir, 8, 321);       // width
+    ASSERT(cache_load("menu_1_1.png") == NULL);
+    patchCacheFiles(dir, 8, 320);
+    patchCacheFiles(dir, 12, 241);      // height
+    ASSERT(cache_load("menu_1_1.png") == NULL);
+    patchCacheFiles(dir, 12, 240);
+    patchCacheFiles(dir, 16, 4);        // stride
+    ASSERT(cache_load("menu_1_1.png") == NULL);
+    patchCacheFiles(dir, 16, 320 * 4);
+    gimg = cache_load("menu_1_1.png");
+    ASSERT(gimg != NULL);
+    gfx_image_free(gimg);
+    patchCacheFiles(dir, 4096 + 320 * 4, 0);
+    ASSERT(cache_load("menu_1_1.png") == NULL);
+    patchCacheFiles(dir, 100, 0);
+    ASSERT(cache_load("menu_1_1.png") == NULL);
+
+    cache_stop();
+    shadow_fini();
+    removeDir(dir);
+
+    return err;
+}
+
+int test_menu_bundle()
+{
+    int err = 0;
+    menu *m, *mb;
+    char fn[] = "menu_%x_%y.png";
+    char bfn[] = "/tmp/frabenu_test_XXXXXX";
+    struct
+    {
+        uint64_t offset;
+        uint32_t width, height, stride, reserved;
+    } idx, bad;                 // bundle_index in bundle.c
+    bundle *b;
+    int fd;
+    int i, y;
+
+    fd = mkstemp(bfn);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    m = menu_creat(3, 2, fn);
+    ASSERT(m != NULL);
+    ASSERT_INTEQ(bundle_write(bfn, m->xMax, m->yMax, m->imgArr), 0);
+
+    // layout must match
+    mb = menu_creat(2, 3, bfn);
+    ASSERT(mb == NULL);
+
+    mb = menu_creat(3, 2, bfn);
+    ASSERT(mb != NULL);
+    for (i = 0; (mb != NULL) && (i < 6); ++i)
+    {
+        ASSERT(mb->imgArr[i] != NULL);
+        ASSERT_INTEQ(mb->imgArr[i]->i.width, m->imgArr[i]->i.width);
+        ASSERT_INTEQ(mb->imgArr[i]->i.height, m->imgArr[i]->i.height);
+        for (y = 0; y < m->imgArr[i]->i.height; ++y)
+        {
+            ASSERT_EX(memcmp(ida_image_scanline(mb->imgArr[i], y), ida_image_scanline(m->imgArr[i], y),
+                             m->imgArr[i]->i.width * 3) == 0, break);
+        }
+    }
+
+    mb = menu_destroy(mb);
+    m = menu_destroy(m);
+
+    // damaged index of the 1st image: size wraps, unaligned, overflow
+    fd = open(bfn, O_RDWR);
+    ASSERT(fd >= 0);
+    ASSERT(pread(fd, &idx, sizeof(idx), 16) == sizeof(idx));
+    bad = idx;
+    bad.width = 0x55555556;     // width * 3 wraps to 2 in 32 bit
+    ASSERT(pwrite(fd, &bad, sizeof(bad), 16) == sizeof(bad));
+    ASSERT(bundle_open(bfn) == NULL);
+    bad = idx;
+    bad.width = 20000;
+    bad.stride = 20000 * 3;
+    bad.height = 1;
+    ASSERT(pwrite(fd, &bad, sizeof(bad), 16) == sizeof(bad));
+    ASSERT(bundle_open(bfn) == NULL);
+    bad = idx;
+    bad.offset += 4;
+    ASSERT(pwrite(fd, &bad, sizeof(bad), 16) == sizeof(bad));
+    ASSERT(bundle_open(bfn) == NULL);
+    bad = idx;
+    bad.offset = UINT64_MAX - 4095;
+    ASSERT(pwrite(fd, &bad, sizeof(bad), 16) == sizeof(bad));
+    ASSERT(bundle_open(bfn) == NULL);
+    bad = idx;
+    bad.stride += 1;
+    ASSERT(pwrite(fd, &bad, sizeof(bad), 16) == sizeof(bad));
+    ASSERT(bundle_open(bfn) == NULL);
+    ASSERT(pwrite(fd, &idx, sizeof(idx), 16) == sizeof(idx));
+    close(fd);
+    b = bundle_open(bfn);
+    ASSERT(b != NULL);
+    bundle_close(b);
+
+    unlink(bfn);
+
     return err;
 }
 
@@ -563,6 +1901,44 @@ int main(int argc, char **argv)
 
     err += test_menu_creat();
 
+    err += test_menu_creat_lazy();
+
+    err += test_menu_native();
+
+    err += test_simd_pack();
+
+    err += test_shadow_double();
+
+    err += test_shadow_spans();
+
+    err += test_transition();
+
+    err += test_trace();
+
+    err += test_mem_gfx();
+
+    err += test_scale_image();
+
+    err += test_menu_budget();
+
+    err += test_menu_prefetch();
+
+    err += test_menu_lazy_failed();
+
+    err += test_menu_signals();
+
+    err += test_key2event();
+
+    err += test_input_epoll();
+
+    err += test_input_evdev();
+
+    err += test_transition_input();
+
+    err += test_menu_cache();
+
+    err += test_menu_bundle();
+
     err += test_menu_img();
 
     err += test_menu_task_m1();
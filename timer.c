@@ -122,3 +122,14 @@ int getMinTimeout(int curTO, int nextTO)
         return nextTO;
     }
 }
+
+
+long getElapsedUs(const struct timespec *start)
+{
+    struct timespec cur;
+    struct timespec diff;
+
+    if (getCurClock(&cur)) { return 0; }
+    timespecDiff(start, &cur, &diff);
+    return diff.tv_sec * 1000000L + diff.tv_nsec / 1000;
+}
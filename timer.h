@@ -30,4 +30,11 @@ int getTimeout(const struct timespec *start, int timeout);
  */
 int getMinTimeout(int curTO, int nextTO);
 
+/**
+ * @brief Get time elapsed since start in us.
+ * @param start     Start point (use getCurClock(&start))
+ * @return          now - start in us
+ */
+long getElapsedUs(const struct timespec *start);
+
 #endif //_FRABENU_TIMER_H_
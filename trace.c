@@ -0,0 +1,140 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "trace.h"
+#include "timer.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *stageName[trace_stage_cnt] =
+{
+    "input", "menu", "draw", "render", "flip"
+};
+
+typedef struct trace_samples
+{
+    long *us;
+    int  cnt;
+    int  size;
+} trace_samples;
+
+static FILE *traceFile = NULL;
+static trace_samples samples[trace_stage_cnt];
+static struct timespec seqStart;
+static unsigned int seqNr = 0;
+static int seqOpen = 0;
+static unsigned int seqDone = 0;    // bit per stage already recorded
+
+
+static void addSample(trace_samples *s, long us)
+{
+    if (s->cnt == s->size)
+    {
+        int size = s->size ? s->size * 2 : 256;
+        long *tmp = realloc(s->us, size * sizeof(long));
+        if (tmp == NULL) { return; }
+        s->us = tmp;
+        s->size = size;
+    }
+    s->us[s->cnt++] = us;
+}
+
+
+int trace_init(const char *fileName)
+{
+    if (traceFile != NULL) { return -1; }
+    if (fileName == NULL) { fileName = getenv(TRACE_ENV); }
+    if ((fileName == NULL) || (fileName[0] == 0)) { return 1; }
+
+    traceFile = fopen(fileName, "w");
+    if (traceFile == NULL)
+    {
+        debugOut(debug_level0, "Can't open trace file %s\n", fileName);
+        return -1;
+    }
+    fputs("seq,stage,us\n", traceFile);
+    memset(samples, 0, sizeof(samples));
+    seqNr = 0;
+    seqOpen = 0;
+    return 0;
+}
+
+
+static int cmpLong(const void *a, const void *b)
+{
+    long la = *(const long *)a;
+    long lb = *(const long *)b;
+    return (la > lb) - (la < lb);
+}
+
+
+long trace_percentile(trace_stage stage, int pct)
+{
+    trace_samples *s;
+    int idx;
+
+    if ((stage < 0) || (stage >= trace_stage_cnt)) { return -1; }
+    s = &samples[stage];
+    if (s->cnt == 0) { return -1; }
+
+    qsort(s->us, s->cnt, sizeof(long), cmpLong);
+    idx = (s->cnt * pct + 99) / 100 - 1;    // nearest rank
+    if (idx < 0)       { idx = 0; }
+    if (idx >= s->cnt) { idx = s->cnt - 1; }
+    return s->us[idx];
+}
+
+
+void trace_stop(void)
+{
+    int i;
+
+    if (traceFile == NULL) { return; }
+
+    debugOut(debug_level0, "latency since input in us:\n");
+    for (i = trace_menu; i < trace_stage_cnt; ++i)
+    {
+        if (samples[i].cnt == 0) { continue; }
+        debugOut(debug_level0, "  %-7s n=%-5d p50=%-8ld p99=%ld\n", stageName[i],
+                 samples[i].cnt, trace_percentile(i, 50), trace_percentile(i, 99));
+    }
+
+    fclose(traceFile);
+    traceFile = NULL;
+    for (i = 0; i < trace_stage_cnt; ++i)
+    {
+        free(samples[i].us);
+    }
+    memset(samples, 0, sizeof(samples));
+}
+
+
+void trace_mark(trace_stage stage)
+{
+    long us;
+
+    if (traceFile == NULL) { return; }
+
+    if (stage == trace_input)
+    {
+        getCurClock(&seqStart);
+        ++seqNr;
+        seqOpen = 1;
+        seqDone = 0;
+    }
+    if (!seqOpen || (seqDone & (1u << stage))) { return; }
+    seqDone |= 1u << stage;
+
+    us = (stage == trace_input) ? 0 : getElapsedUs(&seqStart);
+    addSample(&samples[stage], us);
+    fprintf(traceFile, "%u,%s,%ld\n", seqNr, stageName[stage], us);
+
+    // new image visible, sequence done
+    if (stage == trace_flip) { seqOpen = 0; }
+}
@@ -0,0 +1,62 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#ifndef _FRABENU_TRACE_H_
+#define _FRABENU_TRACE_H_
+
+#define TRACE_ENV   "FRABENU_TRACE"
+
+typedef enum trace_stage
+{
+    trace_input,    // input event arrived, starts a new sequence
+    trace_menu,     // menu_task() done
+    trace_draw,     // image drawn to shadow or framebuffer
+    trace_render,   // shadow converted to the framebuffer
+    trace_flip,     // new image visible (flushed / page flipped)
+
+    trace_stage_cnt
+} trace_stage;
+
+/**
+ * Init latency tracing.
+ *
+ * Every stage is written as CSV line "seq,stage,us" to the trace file,
+ * us is the time since the input event of the sequence.
+ * Call this only once or after calling trace_stop().
+ *
+ * @param fileName  Trace file or NULL to use the file named
+ *                  by the environment variable TRACE_ENV.
+ * @return 0 on success, 1 if tracing is not requested, -1 on error.
+ */
+int trace_init(const char *fileName);
+
+/**
+ * Deinit tracing and print the p50/p99 latency of every stage.
+ *
+ * trace_stop() do nothing if trace_init() is not called before.
+ */
+void trace_stop(void);
+
+/**
+ * @brief Record a stage of the current sequence.
+ *
+ * Only the first occurrence of a stage per sequence is recorded,
+ * nothing is recorded outside of a sequence or without trace_init().
+ * Call this from the main thread only.
+ * @param stage
+ */
+void trace_mark(trace_stage stage);
+
+/**
+ * @brief Get latency percentile of a stage.
+ * @param stage
+ * @param pct   0..100
+ * @return      Latency in us or -1 if nothing recorded.
+ */
+long trace_percentile(trace_stage stage, int pct);
+
+#endif // _FRABENU_TRACE_H_
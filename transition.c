@@ -0,0 +1,251 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#include "transition.h"
+#include "timer.h"
+#include "trace.h"
+#include "fbida/fb-gui.h"
+#include "fbida/fbi.h"
+#include "fbida/vt.h"
+
+#include <string.h>
+
+
+int transition_parse(const char *name, transition_mode *mode)
+{
+    if (strcmp(name, "none") == 0)  { *mode = transition_none;  return 0; }
+    if (strcmp(name, "fade") == 0)  { *mode = transition_fade;  return 0; }
+    if (strcmp(name, "slide") == 0) { *mode = transition_slide; return 0; }
+    return -1;
+}
+
+
+/**
+ * @brief Pixman format matching the framebuffer.
+ * @param gfx
+ * @return      Format or 0 if there is no matching one.
+ */
+static pixman_format_code_t transition_format(const gfxstate *gfx)
+{
+    int alpha = (gfx->tlen == 8) && (gfx->toff == 24);
+
+    switch (gfx->bits_per_pixel)
+    {
+    case 15:
+        if ((gfx->roff == 10) && (gfx->goff == 5) && (gfx->boff == 0)) { return PIXMAN_x1r5g5b5; }
+        break;
+    case 16:
+        if ((gfx->roff == 11) && (gfx->goff == 5) && (gfx->boff == 0)) { return PIXMAN_r5g6b5; }
+        break;
+    case 24:
+        if ((gfx->roff == 16) && (gfx->goff == 8) && (gfx->boff == 0)) { return PIXMAN_r8g8b8; }
+        break;
+    case 32:
+        if ((gfx->roff == 16) && (gfx->goff == 8) && (gfx->boff == 0))
+        {
+            return alpha ? PIXMAN_a8r8g8b8 : PIXMAN_x8r8g8b8;
+        }
+        if ((gfx->roff == 0) && (gfx->goff == 8) && (gfx->boff == 16))
+        {
+            return alpha ? PIXMAN_a8b8g8r8 : PIXMAN_x8b8g8r8;
+        }
+        break;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Top left position of a centered image, same as shadow_draw_image().
+ */
+static void transition_center(const gfxstate *gfx, int width, int height, int *x, int *y)
+{
+    *x = (width  < gfx->hdisplay) ? (gfx->hdisplay - width)  / 2 : 0;
+    *y = (height < gfx->vdisplay) ? (gfx->vdisplay - height) / 2 : 0;
+}
+
+
+/**
+ * @brief Draw one frame using the shadow framebuffer.
+ * @param pos   Progress 0..1000
+ */
+static void transition_frameShadow(gfxstate *gfx, transition_mode mode, int pos,
+                                   const transition_tile *from, const transition_tile *to,
+                                   int dx, int dy)
+{
+    const transition_tile *tile[2] = { from, to };
+    int i, x, y, ox, oy;
+
+    if (mode == transition_fade)
+    {
+        shadow_draw_image(gfx, from->img, 0, 0, 0, gfx->vdisplay-1, 100);
+        shadow_draw_image(gfx, to->img, 0, 0, 0, gfx->vdisplay-1, pos / 10);
+    }
+    else
+    {
+        // old tile moves out, new one follows directly behind
+        ox = -dx * (int)gfx->hdisplay * pos / 1000;
+        oy = -dy * (int)gfx->vdisplay * pos / 1000;
+        shadow_clear();
+        for (i = 0; i < 2; ++i)
+        {
+            struct ida_image *img = tile[i]->img;
+            transition_center(gfx, img->i.width, img->i.height, &x, &y);
+            shadow_composite(img, 0, 0, x + ox, y + oy,
+                             img->i.width, img->i.height, 100);
+            ox += dx * (int)gfx->hdisplay;
+            oy += dy * (int)gfx->vdisplay;
+        }
+    }
+    shadow_render(gfx);
+}
+
+
+/**
+ * @brief Draw one frame directly into the framebuffer.
+ * @param pos   Progress 0..1000
+ */
+static void transition_frameNative(gfxstate *gfx, transition_mode mode, int pos,
+                                   pixman_format_code_t format, pixman_image_t *src[2],
+                                   const transition_tile *from, const transition_tile *to,
+                                   int dx, int dy)
+{
+    const transition_tile *tile[2] = { from, to };
+    const pixman_color_t black = { 0, 0, 0, 0xffff };
+    const pixman_color_t weight = { 0, 0, 0, pos * 0xffff / 1000 };
+    pixman_rectangle16_t all = { 0, 0, gfx->hdisplay, gfx->vdisplay };
+    pixman_image_t *dest, *mask;
+    int i, x, y, ox = 0, oy = 0;
+
+    // gfx->mem changes with every flush if double buffered
+    dest = pixman_image_create_bits(format, gfx->hdisplay, gfx->vdisplay,
+                                    (uint32_t *)gfx->mem, gfx->stride);
+    if (dest == NULL) { return; }
+
+    pixman_image_fill_rectangles(PIXMAN_OP_SRC, dest, &black, 1, &all);
+    if (mode == transition_fade)
+    {
+        mask = pixman_image_create_solid_fill(&weight);
+        transition_center(gfx, from->native->width, from->native->height, &x, &y);
+        pixman_image_composite32(PIXMAN_OP_SRC, src[0], NULL, dest, 0, 0, 0, 0,
+                                 x, y, from->native->width, from->native->height);
+        transition_center(gfx, to->native->width, to->native->height, &x, &y);
+        pixman_image_composite32(PIXMAN_OP_OVER, src[1], mask, dest, 0, 0, 0, 0,
+                                 x, y, to->native->width, to->native->height);
+        pixman_image_unref(mask);
+    }
+    else
+    {
+        ox = -dx * (int)gfx->hdisplay * pos / 1000;
+        oy = -dy * (int)gfx->vdisplay * pos / 1000;
+        for (i = 0; i < 2; ++i)
+        {
+            transition_center(gfx, tile[i]->native->width, tile[i]->native->height, &x, &y);
+            pixman_image_composite32(PIXMAN_OP_SRC, src[i], NULL, dest, 0, 0, 0, 0,
+                                     x + ox, y + oy,
+                                     tile[i]->native->width, tile[i]->native->height);
+            ox += dx * (int)gfx->hdisplay;
+            oy += dy * (int)gfx->vdisplay;
+        }
+    }
+    pixman_image_unref(dest);
+    trace_mark(trace_draw);
+
+    if (gfx->flush_display)
+        gfx->flush_display(false);
+    trace_mark(trace_flip);
+}
+
+
+int transition_run(gfxstate *gfx, transition_mode mode, int duration,
+                   const transition_tile *from, const transition_tile *to,
+                   int dx, int dy, transition_wait wait, transition_perf *perf)
+{
+    const long frameUs = 1000000L / TRANSITION_FPS;
+    pixman_format_code_t format = 0;
+    pixman_image_t *src[2] = { NULL, NULL };
+    pixman_image_t *dest;
+    struct timespec start, frameStart;
+    transition_perf stat;
+    long elapsed, render;
+    int retval = 0;
+    int native;
+    int i;
+
+    memset(&stat, 0, sizeof(stat));
+    if (perf != NULL) { *perf = stat; }
+
+    if ((mode == transition_none) || (duration <= 0) || !console_visible) { return -1; }
+    if ((from == NULL) || (to == NULL)) { return -1; }
+    if ((mode == transition_slide) && (dx == 0) && (dy == 0)) { return -1; }
+
+    native = (from->native != NULL) && (to->native != NULL);
+    if (native)
+    {
+        const struct gfx_image *n[2] = { from->native, to->native };
+        format = transition_format(gfx);
+        if (format == 0) { return -1; }
+        // pixman needs 32 bit aligned lines, e.g. not given for some 24 bpp
+        // modes, then every frame would draw nothing, let the caller draw
+        if ((gfx->stride % 4) != 0) { return -1; }
+        dest = pixman_image_create_bits(format, gfx->hdisplay, gfx->vdisplay,
+                                        (uint32_t *)gfx->mem, gfx->stride);
+        if (dest == NULL) { return -1; }
+        pixman_image_unref(dest);
+        for (i = 0; i < 2; ++i)
+        {
+            src[i] = pixman_image_create_bits(format, n[i]->width, n[i]->height,
+                                              (uint32_t *)n[i]->data, n[i]->stride);
+        }
+        if ((src[0] == NULL) || (src[1] == NULL)) { retval = -1; goto out; }
+    }
+    else if ((from->img == NULL) || (to->img == NULL))
+    {
+        return -1;
+    }
+
+    getCurClock(&start);
+    for (;;)
+    {
+        elapsed = getElapsedUs(&start);
+        if (elapsed >= duration * 1000L) { break; }
+
+        // position from the real time, so slow frames are skipped
+        getCurClock(&frameStart);
+        if (native)
+        {
+            transition_frameNative(gfx, mode, elapsed / duration, format, src,
+                                   from, to, dx, dy);
+        }
+        else
+        {
+            transition_frameShadow(gfx, mode, elapsed / duration, from, to, dx, dy);
+        }
+        render = getElapsedUs(&frameStart);
+        ++stat.frames;
+        stat.renderUs += render;
+        if (render > stat.maxRenderUs) { stat.maxRenderUs = render; }
+
+        // sleep until the next frame is due, but wake up on input
+        elapsed = getElapsedUs(&start);
+        elapsed = ((elapsed / frameUs + 1) * frameUs - elapsed + 999) / 1000;
+        if ((wait != NULL) && wait((int)elapsed))
+        {
+            retval = 1;
+            break;
+        }
+    }
+    stat.totalUs = getElapsedUs(&start);
+    if (perf != NULL) { *perf = stat; }
+
+out:
+    for (i = 0; i < 2; ++i)
+    {
+        if (src[i] != NULL) { pixman_image_unref(src[i]); }
+    }
+    return retval;
+}
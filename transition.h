@@ -0,0 +1,73 @@
+/* *******************************************
+ * frabenu - Framebuffer menu
+ * Copyright (C) 2018 Frank Mueller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * *******************************************/
+
+#ifndef _FRABENU_TRANSITION_H_
+#define _FRABENU_TRANSITION_H_
+
+#include "fbida/gfx.h"
+
+#define TRANSITION_FPS  60
+
+typedef enum transition_mode
+{
+    transition_none,    // switch instantly
+    transition_fade,    // crossfade
+    transition_slide    // new tile pushes the old one out
+} transition_mode;
+
+// one menu tile, either as RGB or as framebuffer format image
+typedef struct transition_tile
+{
+    struct ida_image *img;
+    struct gfx_image *native;
+} transition_tile;
+
+typedef struct transition_perf
+{
+    int  frames;        // frames shown
+    long totalUs;       // whole transition
+    long renderUs;      // sum of all frames without waiting
+    long maxRenderUs;   // slowest frame
+} transition_perf;
+
+/**
+ * @brief Wait for the next frame.
+ * @param timeout   Max. time to wait in ms.
+ * @return          != 0 to cancel the transition (new input)
+ */
+typedef int (*transition_wait)(int timeout);
+
+/**
+ * @brief Parse a transition name ("none", "fade", "slide").
+ * @param name
+ * @param mode      Result
+ * @return          0 on success, -1 on unknown name
+ */
+int transition_parse(const char *name, transition_mode *mode);
+
+/**
+ * @brief Show the frames of a transition between two tiles.
+ *
+ * Frames are rendered at TRANSITION_FPS, late frames are skipped.
+ * The final state is not drawn, draw the new tile afterwards.
+ * Both tiles must be of the same kind (RGB or framebuffer format).
+ * @param gfx
+ * @param mode
+ * @param duration  Length in ms
+ * @param from      Tile currently shown
+ * @param to        New tile
+ * @param dx        Move direction (-1, 0, 1), used for sliding
+ * @param dy        Move direction (-1, 0, 1), used for sliding
+ * @param wait      Called after every frame
+ * @param perf      Gets frame statistics or NULL
+ * @return          0 done, 1 canceled, -1 not possible with these tiles
+ */
+int transition_run(gfxstate *gfx, transition_mode mode, int duration,
+                   const transition_tile *from, const transition_tile *to,
+                   int dx, int dy, transition_wait wait, transition_perf *perf);
+
+#endif // _FRABENU_TRANSITION_H_